@@ -0,0 +1,71 @@
+#ifndef alloc_count_h
+#define alloc_count_h
+
+#include "deck.h"
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+/*
+    Counts heap allocations, to check that the hot paths don't make any.
+
+    This replaces the global operator new and delete (plain, array and aligned), so
+    only the .cpp with main() may include it (every tool here is a single file, so
+    that is the only one). Each thread counts its own allocations with no atomics or
+    locks: a worker reads heap_allocations() before and after its loop and the
+    difference is what the loop allocated.
+*/
+
+thread_local uint64 threadAllocations = 0;
+
+// allocations made by the calling thread so far
+inline uint64 heap_allocations() {
+    return threadAllocations;
+}
+
+/*
+    The one place memory is got and given back. They are kept out of line so the
+    compiler never sees free() on a pointer that came from operator new (which it
+    would flag under -Wmismatched-new-delete). Aligned blocks come from
+    aligned_alloc, which free() takes back too.
+*/
+__attribute__((noinline)) inline void* counted_alloc(size_t size, size_t align) {
+    ++threadAllocations;
+    size = size ? size : 1;
+    void* p = align <= alignof(std::max_align_t)
+                  ? malloc(size)
+                  : aligned_alloc(align, (size + align - 1) / align * align);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) inline void counted_free(void* p) noexcept {
+    free(p);
+}
+
+// the array and aligned forms go through these too, so every allocation is counted once
+void* operator new(size_t size) {
+    return counted_alloc(size, 0);
+}
+void* operator new[](size_t size) {
+    return ::operator new(size);
+}
+void* operator new(size_t size, std::align_val_t align) {
+    return counted_alloc(size, size_t(align));
+}
+void* operator new[](size_t size, std::align_val_t align) {
+    return ::operator new(size, align);
+}
+
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete(void* p, size_t) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete[](void* p, size_t) noexcept { counted_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { counted_free(p); }
+
+#endif /* alloc_count_h */
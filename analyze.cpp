@@ -0,0 +1,376 @@
+#include <iostream>
+#include "deck.h"
+#include "card_utils.h"
+#include "gin_rummy.h"
+#include "game_log.h"
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+    Statistics over game logs (gin_rummy --log, tournament --log). Usage:
+        ./analyze games.log [more.log ...] [--threads T] [--chunk KB] [--verify]
+
+    The files are read in fixed-size chunks by one reader thread and the chunks are
+    handed to worker threads, each summing into its own stats. Only a fixed pool of
+    chunks is ever allocated, so memory stays the same however big the archive is.
+
+    Every knock is scored again with score_knock from the two deadwood counts in the
+    log. --verify goes further and replays each round (replay_round), which works
+    both hands' deadwood out again with the meld solver.
+*/
+
+const size_t DEFAULT_CHUNK_KB = 1024;
+const size_t MIN_CHUNK = 128 * 1024;    // always bigger than the biggest possible round
+const int MAX_TURNS = 60;               // longer rounds share the last histogram bucket
+
+// a piece of a log holding whole rounds only
+struct Chunk {
+    vector<uint8> bytes;
+    size_t length = 0;
+};
+
+// a blocking queue of chunks; the pool of chunks circulates between two of these
+class ChunkQueue
+{
+private:
+    mutex lock;
+    condition_variable ready;
+    deque<Chunk*> items;
+    bool closed = false;
+
+public:
+    void push(Chunk* chunk) {
+        {
+            lock_guard<mutex> guard(lock);
+            items.push_back(chunk);
+        }
+        ready.notify_one();
+    }
+
+    // nullptr once the queue is closed and empty
+    Chunk* pop() {
+        unique_lock<mutex> guard(lock);
+        ready.wait(guard, [&] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return nullptr;
+        }
+        Chunk* chunk = items.front();
+        items.pop_front();
+        return chunk;
+    }
+
+    void close() {
+        {
+            lock_guard<mutex> guard(lock);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+};
+
+struct alignas(64) Stats {
+    uint64 rounds = 0;
+    uint64 ends[5] = {0, 0, 0, 0, 0};               // by RoundEnd
+    uint64 knockDeadwood[knock_limit + 1] = {};     // knocker's deadwood when knocking
+    uint64 opponentDeadwood = 0;                    // summed over knocks
+    uint64 turns[MAX_TURNS + 1] = {};
+    uint64 turnTotal = 0;
+    uint64 draws[2] = {0, 0};                       // by position: 0 = moved first, 1 = second
+    uint64 discardDraws[2] = {0, 0};
+    uint64 wins[2] = {0, 0};                        // by position
+    uint64 points[2] = {0, 0};                      // by position
+    uint64 rescoreMismatches = 0;
+    uint64 replayFailures = 0;
+
+    void merge(const Stats& o) {
+        rounds += o.rounds;
+        opponentDeadwood += o.opponentDeadwood;
+        turnTotal += o.turnTotal;
+        rescoreMismatches += o.rescoreMismatches;
+        replayFailures += o.replayFailures;
+        for (int i = 0; i < 5; ++i) {
+            ends[i] += o.ends[i];
+        }
+        for (int i = 0; i <= knock_limit; ++i) {
+            knockDeadwood[i] += o.knockDeadwood[i];
+        }
+        for (int i = 0; i <= MAX_TURNS; ++i) {
+            turns[i] += o.turns[i];
+        }
+        for (int p = 0; p < 2; ++p) {
+            draws[p] += o.draws[p];
+            discardDraws[p] += o.discardDraws[p];
+            wins[p] += o.wins[p];
+            points[p] += o.points[p];
+        }
+    }
+};
+
+void add_round(const LoggedRound& round, bool verify, Stats& s) {
+    const LogRound& h = round.header;
+    s.rounds++;
+    if (h.end < 5) {
+        s.ends[h.end]++;
+    }
+    s.turns[h.turns < MAX_TURNS ? h.turns : MAX_TURNS]++;
+    s.turnTotal += h.turns;
+
+    // draws alternate, starting with whoever moved first
+    int position = 0;
+    bool first = true;
+    for (int i = 0; i < h.eventCount; ++i) {
+        LogEvent type = event_type(round.events[i]);
+        if (type != LogEvent::DrawStock && type != LogEvent::DrawDiscard) {
+            continue;
+        }
+        if (!first) {
+            position = 1 - position;
+        }
+        first = false;
+        s.draws[position]++;
+        if (type == LogEvent::DrawDiscard) {
+            s.discardDraws[position]++;
+        }
+    }
+
+    if (h.knocker >= 0) {
+        s.knockDeadwood[h.knockerDeadwood <= knock_limit ? h.knockerDeadwood : knock_limit]++;
+        s.opponentDeadwood += h.opponentDeadwood;
+
+        KnockResult score = score_knock(h.knockerDeadwood, h.opponentDeadwood);
+        int winner = score.knockerWins ? h.knocker : 1 - h.knocker;
+        if (uint8(score.type) != h.end || score.points != h.points || winner != h.winner) {
+            s.rescoreMismatches++;
+        }
+    }
+    if (h.winner >= 0) {
+        int winnerPosition = h.winner == h.firstSeat ? 0 : 1;
+        s.wins[winnerPosition]++;
+        s.points[winnerPosition] += h.points;
+    }
+
+    if (verify) {
+        RoundResult result;
+        HandMask hands[2];
+        if (!replay_round(round, result, hands)) {
+            s.replayFailures++;
+        }
+    }
+}
+
+void worker(ChunkQueue& full, ChunkQueue& empty, bool verify, Stats& stats) {
+    while (Chunk* chunk = full.pop()) {
+        size_t pos = 0;
+        LoggedRound round;
+        while (pos < chunk->length) {
+            memcpy(&round.header, chunk->bytes.data() + pos, sizeof(LogRound));
+            round.events = chunk->bytes.data() + pos + sizeof(LogRound);
+            add_round(round, verify, stats);
+            pos += sizeof(LogRound) + round.header.eventCount;
+        }
+        empty.push(chunk);
+    }
+}
+
+/*
+    Read one log into chunks. A round that runs past the end of a chunk is carried to
+    the front of the next one, so workers only ever see whole rounds.
+    Returns false if the file isn't a game log.
+*/
+bool read_log(const string& path, size_t chunkSize, ChunkQueue& full, ChunkQueue& empty,
+              uint64& bytesRead) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    char magic[sizeof(log_magic)];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, log_magic, sizeof(magic)) != 0) {
+        fclose(file);
+        return false;
+    }
+    bytesRead += sizeof(magic);
+
+    size_t carried = 0;
+    uint8 carry[sizeof(LogRound) + 0xFFFF];
+    while (true) {
+        Chunk* chunk = empty.pop();
+        memcpy(chunk->bytes.data(), carry, carried);
+        size_t filled = carried + fread(chunk->bytes.data() + carried, 1, chunkSize - carried, file);
+        bytesRead += filled - carried;
+
+        // find where the last whole round ends
+        size_t pos = 0;
+        while (filled - pos >= sizeof(LogRound)) {
+            uint16 eventCount;
+            memcpy(&eventCount, chunk->bytes.data() + pos + offsetof(LogRound, eventCount),
+                   sizeof(eventCount));
+            if (filled - pos - sizeof(LogRound) < eventCount) {
+                break;
+            }
+            pos += sizeof(LogRound) + eventCount;
+        }
+        carried = filled - pos;
+        memcpy(carry, chunk->bytes.data() + pos, carried);
+        chunk->length = pos;
+
+        bool atEnd = filled < chunkSize;
+        if (pos > 0) {
+            full.push(chunk);
+        } else {
+            empty.push(chunk);
+        }
+        if (atEnd) {
+            break;      // anything still carried is a round cut off by a crash
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+string percent(uint64 part, uint64 whole) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%6.2f%%", whole ? 100.0 * part / whole : 0.0);
+    return buffer;
+}
+
+string bar(uint64 count, uint64 most) {
+    return string(most ? size_t(40.0 * count / most + 0.5) : 0, '#');
+}
+
+void print_report(const Stats& s, uint64 bytes, double seconds) {
+    uint64 knocks = s.ends[uint8(RoundEnd::Knock)] + s.ends[uint8(RoundEnd::Gin)] +
+                    s.ends[uint8(RoundEnd::Undercut)];
+
+    cout << "\n========== ARCHIVE ==========\n";
+    cout << s.rounds << " rounds, " << bytes << " bytes in " << seconds << " s ("
+         << (seconds > 0 ? s.rounds / seconds : 0) << " rounds/s)\n";
+    cout << "average round: " << (s.rounds ? double(s.turnTotal) / s.rounds : 0) << " turns\n\n";
+
+    cout << "knocks:           " << percent(s.ends[uint8(RoundEnd::Knock)], s.rounds) << " of rounds\n";
+    cout << "gins:             " << percent(s.ends[uint8(RoundEnd::Gin)], s.rounds) << " of rounds, "
+         << percent(s.ends[uint8(RoundEnd::Gin)], knocks) << " of knocks\n";
+    cout << "undercuts:        " << percent(s.ends[uint8(RoundEnd::Undercut)], s.rounds)
+         << " of rounds, " << percent(s.ends[uint8(RoundEnd::Undercut)], knocks) << " of knocks\n";
+    cout << "stock-outs:       " << percent(s.ends[uint8(RoundEnd::StockOut)], s.rounds) << " of rounds\n";
+    cout << "discard draws:    " << percent(s.discardDraws[0] + s.discardDraws[1], s.draws[0] + s.draws[1])
+         << " of draws (first player " << percent(s.discardDraws[0], s.draws[0]).substr(1)
+         << ", second " << percent(s.discardDraws[1], s.draws[1]).substr(1) << ")\n";
+
+    uint64 scored = s.wins[0] + s.wins[1];
+    double p = scored ? double(s.wins[0]) / scored : 0;
+    double spread = scored ? 1.96 * sqrt(p * (1 - p) / scored) : 0;
+    cout << "\nfirst player wins " << percent(s.wins[0], scored) << " +/- "
+         << 100 * spread << "% of scored rounds, "
+         << (s.rounds ? double(s.points[0]) / s.rounds : 0) << " vs "
+         << (s.rounds ? double(s.points[1]) / s.rounds : 0) << " points per round\n";
+
+    cout << "\nknocker's deadwood (opponent averaged "
+         << (knocks ? double(s.opponentDeadwood) / knocks : 0) << ")\n";
+    uint64 most = 0;
+    for (uint64 n : s.knockDeadwood) {
+        most = n > most ? n : most;
+    }
+    for (int d = 0; d <= knock_limit; ++d) {
+        char line[64];
+        snprintf(line, sizeof(line), "  %2d %s  ", d, percent(s.knockDeadwood[d], knocks).c_str());
+        cout << line << bar(s.knockDeadwood[d], most) << '\n';
+    }
+
+    cout << "\nturns per round\n";
+    most = 0;
+    int last = 0;
+    for (int t = 0; t <= MAX_TURNS; ++t) {
+        most = s.turns[t] > most ? s.turns[t] : most;
+        last = s.turns[t] ? t : last;
+    }
+    for (int t = 1; t <= last; ++t) {
+        char line[64];
+        snprintf(line, sizeof(line), "  %2d%s %s  ", t, t == MAX_TURNS ? "+" : " ",
+                 percent(s.turns[t], s.rounds).c_str());
+        cout << line << bar(s.turns[t], most) << '\n';
+    }
+
+    cout << "\nrescored knocks that disagree with the log: " << s.rescoreMismatches << '\n';
+    cout << "rounds that didn't replay: " << s.replayFailures << '\n';
+}
+
+int main(int argc, const char * argv[]) {
+    vector<string> paths;
+    unsigned threads = thread::hardware_concurrency();
+    size_t chunkSize = DEFAULT_CHUNK_KB * 1024;
+    bool verify = false;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--threads" && hasValue) {
+            threads = unsigned(atoi(argv[++i]));
+        } else if (arg == "--chunk" && hasValue) {
+            chunkSize = size_t(strtoull(argv[++i], nullptr, 10)) * 1024;
+        } else if (arg == "--verify") {
+            verify = true;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            cout << "usage: analyze games.log [more.log ...] [--threads T] [--chunk KB] [--verify]\n";
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        cout << "usage: analyze games.log [more.log ...] [--threads T] [--chunk KB] [--verify]\n";
+        return 1;
+    }
+    if (threads == 0) threads = 1;
+    if (chunkSize < MIN_CHUNK) chunkSize = MIN_CHUNK;
+
+    // two chunks per worker: one being summed, one being filled
+    vector<Chunk> pool(2 * threads);
+    ChunkQueue full, empty;
+    for (Chunk& chunk : pool) {
+        chunk.bytes.resize(chunkSize);
+        empty.push(&chunk);
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    vector<Stats> stats(threads);
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back(worker, ref(full), ref(empty), verify, ref(stats[t]));
+    }
+
+    uint64 bytes = 0;
+    bool ok = true;
+    for (const string& path : paths) {
+        if (!read_log(path, chunkSize, full, empty, bytes)) {
+            cout << "Can't read a game log from " << path << '\n';
+            ok = false;
+        }
+    }
+    full.close();
+    for (thread& t : workers) {
+        t.join();
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    Stats total;
+    for (const Stats& s : stats) {
+        total.merge(s);
+    }
+    print_report(total, bytes, seconds);
+
+    return ok && total.rescoreMismatches == 0 && total.replayFailures == 0 ? 0 : 1;
+}
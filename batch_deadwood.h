@@ -0,0 +1,50 @@
+#ifndef batch_deadwood_h
+#define batch_deadwood_h
+
+#include "deck.h"
+#include "batch_kernel.h"
+#include "card_utils.h"
+#include "gin_rummy.h"
+#include <cstddef>
+
+/*
+    Least deadwood and knockability for a whole array of one-pack hands at once, for
+    analytics and searches that score thousands of hands rather than one.
+
+    Hands go in as a plain HandMask array and the answers come out in arrays of
+    their own, so every pass streams through memory in order. The hands with no
+    card in both a set and a run are all bit operations, done by meld_free_deadwood
+    (batch_kernel.h) four hands a step with AVX2. The few hands with an overlap to
+    resolve come back marked and are handed to MeldSolver afterwards, one at a time.
+
+    The kernel is picked once from what the CPU has; the scalar one does the same
+    thing with the ordinary single-hand functions, and both give exactly
+    min_deadwood's answer.
+*/
+
+/*
+    deadwood[i] = min_deadwood(hands[i]) for count hands, and if knockable isn't
+    nullptr, knockable[i] = 1 when that is within knock_limit, else 0.
+*/
+inline void batch_deadwood(const HandMask* hands, size_t count, uint16* deadwood,
+                           uint8* knockable, BatchKernel kernel) {
+    meld_free_deadwood(hands, count, deadwood, kernel);
+    for (size_t i = 0; i < count; ++i) {
+        if (deadwood[i] == overlapping_melds) {
+            MeldSolver solver(hands[i]);
+            deadwood[i] = uint16(solver.min_deadwood(hands[i]));
+        }
+    }
+    if (knockable) {
+        for (size_t i = 0; i < count; ++i) {
+            knockable[i] = uint8(deadwood[i] <= knock_limit);
+        }
+    }
+}
+
+inline void batch_deadwood(const HandMask* hands, size_t count, uint16* deadwood,
+                           uint8* knockable = nullptr) {
+    batch_deadwood(hands, count, deadwood, knockable, best_batch_kernel());
+}
+
+#endif /* batch_deadwood_h */
@@ -0,0 +1,156 @@
+#ifndef batch_kernel_h
+#define batch_kernel_h
+
+#include "deck.h"
+#include <cstddef>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_DEADWOOD_AVX2 1
+#endif
+
+/*
+    The bit-operation half of scoring many one-pack hands at once, kept apart from
+    the solvers so that card_utils.h (the bot's discard scoring) and batch_deadwood.h
+    (whole arrays) can both use it.
+
+    Most hands have no card in both a set and a run, and for those the least
+    deadwood is just set_cards, run_cards and the weighted popcount of
+    deadwood_value. meld_free_deadwood does that for every hand in an array, four
+    hands a step with AVX2, and marks the hands with an overlap as
+    overlapping_melds for the caller to solve its own way.
+*/
+
+enum class BatchKernel : uint8 {
+    Scalar,
+    Avx2
+};
+
+// deadwood written for a hand whose melds overlap; no hand can have this much
+constexpr uint16 overlapping_melds = 0xFFFF;
+
+inline const char* batch_kernel_name(BatchKernel kernel) {
+    return kernel == BatchKernel::Avx2 ? "avx2" : "scalar";
+}
+
+// the best kernel this CPU can run
+inline BatchKernel best_batch_kernel() {
+#ifdef BATCH_DEADWOOD_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        return BatchKernel::Avx2;
+    }
+#endif
+    return BatchKernel::Scalar;
+}
+
+namespace batch_detail {
+
+inline void scalar_meld_free(const HandMask* hands, size_t count, uint16* deadwood) {
+    for (size_t i = 0; i < count; ++i) {
+        HandMask sets = set_cards(hands[i]);
+        HandMask runs = run_cards(hands[i]);
+        deadwood[i] = (sets & runs) ? overlapping_melds
+                                    : uint16(deadwood_value(hands[i] & ~(sets | runs)));
+    }
+}
+
+#ifdef BATCH_DEADWOOD_AVX2
+
+// bytes of x -> the number of bits set in each
+__attribute__((target("avx2")))
+inline __m256i byte_popcount(__m256i x) {
+    const __m256i nibbleCounts = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                  0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low4 = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_and_si256(x, low4);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), low4);
+    return _mm256_add_epi8(_mm256_shuffle_epi8(nibbleCounts, lo),
+                           _mm256_shuffle_epi8(nibbleCounts, hi));
+}
+
+/*
+    Four hands per 256-bit register, one per 64-bit element, each step the same
+    bit operations as set_cards / run_cards / deadwood_value. The four value planes'
+    byte counts are folded into one weighted count per byte (at most 8 * 15, so it
+    fits) and _mm256_sad_epu8 adds each hand's 8 bytes together.
+*/
+__attribute__((target("avx2")))
+inline void avx2_meld_free(const HandMask* hands, size_t count, uint16* deadwood) {
+    const __m256i ranks = _mm256_set1_epi64x(int64_t(lane_ranks));
+    const __m256i plane0 = _mm256_set1_epi64x(int64_t(value_bit0));
+    const __m256i plane1 = _mm256_set1_epi64x(int64_t(value_bit1));
+    const __m256i plane2 = _mm256_set1_epi64x(int64_t(value_bit2));
+    const __m256i plane3 = _mm256_set1_epi64x(int64_t(value_bit3));
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i m = _mm256_loadu_si256((const __m256i*) (hands + i));
+
+        // set_ranks: the 4-input majority of the suit lanes, then repeated into every lane
+        __m256i a = _mm256_and_si256(m, ranks);
+        __m256i b = _mm256_and_si256(_mm256_srli_epi64(m, lanewidth), ranks);
+        __m256i c = _mm256_and_si256(_mm256_srli_epi64(m, 2 * lanewidth), ranks);
+        __m256i d = _mm256_srli_epi64(m, 3 * lanewidth);
+        __m256i setRanks = _mm256_or_si256(
+            _mm256_and_si256(_mm256_and_si256(a, b), _mm256_or_si256(c, d)),
+            _mm256_and_si256(_mm256_and_si256(c, d), _mm256_or_si256(a, b)));
+        __m256i setColumns = _mm256_or_si256(
+            _mm256_or_si256(setRanks, _mm256_slli_epi64(setRanks, lanewidth)),
+            _mm256_or_si256(_mm256_slli_epi64(setRanks, 2 * lanewidth),
+                            _mm256_slli_epi64(setRanks, 3 * lanewidth)));
+        __m256i sets = _mm256_and_si256(m, setColumns);
+
+        // run_cards: the starts of 3 in a row, spread over the run
+        __m256i starts = _mm256_and_si256(
+            m, _mm256_and_si256(_mm256_srli_epi64(m, 1), _mm256_srli_epi64(m, 2)));
+        __m256i runs = _mm256_or_si256(
+            starts, _mm256_or_si256(_mm256_slli_epi64(starts, 1), _mm256_slli_epi64(starts, 2)));
+
+        __m256i dead = _mm256_andnot_si256(_mm256_or_si256(sets, runs), m);
+        __m256i weighted = byte_popcount(_mm256_and_si256(dead, plane3));
+        weighted = _mm256_add_epi8(_mm256_add_epi8(weighted, weighted),
+                                   byte_popcount(_mm256_and_si256(dead, plane2)));
+        weighted = _mm256_add_epi8(_mm256_add_epi8(weighted, weighted),
+                                   byte_popcount(_mm256_and_si256(dead, plane1)));
+        weighted = _mm256_add_epi8(_mm256_add_epi8(weighted, weighted),
+                                   byte_popcount(_mm256_and_si256(dead, plane0)));
+        alignas(32) uint64 sums[4];
+        _mm256_store_si256((__m256i*) sums, _mm256_sad_epu8(weighted, zero));
+
+        // the hands with a card in both a set and a run are left for the caller
+        __m256i clash = _mm256_cmpeq_epi64(_mm256_and_si256(sets, runs), zero);
+        int overlaps = ~_mm256_movemask_pd(_mm256_castsi256_pd(clash)) & 0xF;
+        for (int k = 0; k < 4; ++k) {
+            deadwood[i + k] = (overlaps >> k & 1) ? overlapping_melds : uint16(sums[k]);
+        }
+    }
+    scalar_meld_free(hands + i, count - i, deadwood + i);
+}
+
+#endif
+
+}
+
+/*
+    deadwood[i] = the deadwood of hands[i] with every set and run it holds melded,
+    or overlapping_melds if some card is in both a set and a run (then min_deadwood
+    has to choose, and this doesn't try).
+*/
+inline void meld_free_deadwood(const HandMask* hands, size_t count, uint16* deadwood,
+                               BatchKernel kernel) {
+#ifdef BATCH_DEADWOOD_AVX2
+    if (kernel == BatchKernel::Avx2) {
+        batch_detail::avx2_meld_free(hands, count, deadwood);
+        return;
+    }
+#endif
+    (void) kernel;
+    batch_detail::scalar_meld_free(hands, count, deadwood);
+}
+
+inline void meld_free_deadwood(const HandMask* hands, size_t count, uint16* deadwood) {
+    meld_free_deadwood(hands, count, deadwood, best_batch_kernel());
+}
+
+#endif /* batch_kernel_h */
@@ -0,0 +1,1374 @@
+#include <iostream>
+#include "deck.h"
+#include "card_utils.h"
+#include "gin_rummy.h"
+#include "alloc_count.h"
+#include "endgame.h"
+#include "deadwood_cache.h"
+#include "batch_deadwood.h"
+#include "engine_protocol.h"
+#include "hand_values.h"
+#include "outs.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+    Microbenchmarks for the card kernels. Usage:
+        ./bench                      JSON report on stdout
+        ./bench --out bench.json     ...or into a file
+        ./bench --quick              fewer samples, for a fast sanity run
+        ./bench --filter find_runs   only benchmarks whose name contains the text
+
+    Every benchmark runs over fixed-seed corpora, so two runs time the same work and
+    their JSON can be diffed. Each benchmark is timed as a series of samples; ns/op
+    is reported as mean and p50/p90/p99 over the samples, and allocations/op comes
+    from the counting operator new in alloc_count.h.
+
+    Before timing, the solver is checked against min_deadwood_reference on every
+    corpus hand and on 20000 made-up hands of 1 to 13 cards (half of them packed
+    with overlapping melds), solve_melds' arrangement included, and simulated
+    rounds and turns are checked to make no heap allocations once warmed up;
+    either failing fails the run. The endgame solver is checked the same way,
+    against a plain alpha-beta with no table that plays every line on a Round, and
+    a threaded solve has to give exactly the values of a serial one. The deadwood
+    cache has to give the solver's answer for every corpus hand in all 24 suit
+    orders, and layoffs have to match laying off every card in every order. Each
+    rule variant has to keep to its rules over a few hundred bot rounds.
+
+    "legacy_*" is the Deck as it was first written (global rand() % n, a fresh vector
+    per deck and vector::erase per dealt card), kept so every run shows the before
+    and after side by side.
+*/
+
+namespace legacy {
+
+class Deck
+{
+private:
+    uint16 remainingCardCount = 0;
+    std::vector<Card> deck;
+
+public:
+    void create_deck() {
+        deck.clear();
+        for (uint8 n_suit = 1; n_suit <= suitcount; ++n_suit) {
+            for (uint8 n_rank = 1; n_rank <= rankcount; ++n_rank) {
+                Card temp = {n_suit, n_rank};
+                deck.push_back(temp);
+            }
+        }
+        remainingCardCount = deck.size();
+    }
+
+    void shuffle_deck() {
+        uint16 ncards = remainingCardCount;
+        for (uint16 i = 0; i < ncards; ++i) {
+            uint16 r = i + (rand() % (ncards - i));
+            if (r != i) {
+                std::swap(deck[r], deck[i]);
+            }
+        }
+    }
+
+    uint16 remaining() const {
+        return remainingCardCount;
+    }
+
+    Card deal_card() {
+        Card returnCard = deck[deck.size() - 1];
+        deck.erase(deck.begin() + deck.size() - 1);
+        remainingCardCount = deck.size();
+        return returnCard;
+    }
+
+    std::vector<Card> deal_hand(uint8 n) {
+        std::vector<Card> temp;
+        for (int i = 0; i < n; ++i) {
+            temp.push_back(deal_card());
+        }
+        return temp;
+    }
+};
+
+}
+
+// keeps the optimiser from throwing away work whose result is never used
+volatile uint64 sink = 0;
+
+const uint64 CORPUS_SEED = 20240601;
+const int CORPUS_HANDS = 4096;
+const int SOLVER_RANDOM_HANDS = 20000;     // made-up hands the solver is checked on
+const int HAND_SIZES[] = {3, 7, 10, 11};
+const int SHOE_DECKS[] = {2, 4, 10};     // packs per shoe for the shoe corpora (10-card hands)
+const char* HAND_TABLE_PATH = "/tmp/gin_bench_hands.db";   // written and mapped by the checks
+
+struct Corpus {
+    int handSize;
+    vector<vector<Card>> hands;
+    vector<HandMask> masks;
+    vector<MeldList> sets, runs;    // precomputed, so calculate_deadwood is timed alone
+};
+
+// hands dealt from a shoe, so cards repeat
+struct ShoeCorpus {
+    int decks;
+    vector<CardCounts> hands;
+};
+
+ShoeCorpus make_shoe_corpus(int decks, uint64 seed) {
+    ShoeCorpus corpus;
+    corpus.decks = decks;
+    Deck deck{Rng(seed), uint8(decks)};
+    for (int i = 0; i < CORPUS_HANDS; ++i) {
+        deck.new_deck();
+        corpus.hands.push_back(deck.deal_counts(standard_hand_size));
+    }
+    return corpus;
+}
+
+Corpus make_corpus(int handSize, uint64 seed) {
+    Corpus corpus;
+    corpus.handSize = handSize;
+    Deck deck{Rng(seed)};
+    for (int i = 0; i < CORPUS_HANDS; ++i) {
+        deck.new_deck();
+        corpus.hands.push_back(deck.deal_hand(handSize));
+        corpus.masks.push_back(to_mask(corpus.hands.back()));
+        corpus.sets.push_back(find_sets(corpus.hands.back()));
+        corpus.runs.push_back(find_runs(corpus.hands.back()));
+    }
+    return corpus;
+}
+
+struct BenchResult {
+    string name;
+    uint64 opsPerSample = 0;
+    int samples = 0;
+    double mean = 0, p50 = 0, p90 = 0, p99 = 0;  // ns per op
+    double allocationsPerOp = 0;
+};
+
+double percentile(const vector<double>& sorted, double fraction) {
+    size_t index = size_t(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+/*
+    Time fn as `samples` samples of `ops` calls each. fn(i) gets a running op
+    number, so it can walk through a corpus.
+*/
+template <typename Fn>
+BenchResult run_bench(const string& name, int samples, uint64 ops, Fn fn) {
+    BenchResult result;
+    result.name = name;
+    result.opsPerSample = ops;
+    result.samples = samples;
+
+    // one untimed sample to warm caches and branch predictors
+    for (uint64 i = 0; i < ops; ++i) {
+        fn(i);
+    }
+
+    vector<double> nsPerOp;
+    nsPerOp.reserve(samples);
+    uint64 allocationsBefore = heap_allocations();
+    uint64 op = 0;
+    for (int s = 0; s < samples; ++s) {
+        auto start = chrono::steady_clock::now();
+        for (uint64 i = 0; i < ops; ++i) {
+            fn(op++);
+        }
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        nsPerOp.push_back(ns / ops);
+    }
+    result.allocationsPerOp = double(heap_allocations() - allocationsBefore) / op;
+
+    double total = 0;
+    for (double v : nsPerOp) {
+        total += v;
+    }
+    result.mean = total / samples;
+    sort(nsPerOp.begin(), nsPerOp.end());
+    result.p50 = percentile(nsPerOp, 0.50);
+    result.p90 = percentile(nsPerOp, 0.90);
+    result.p99 = percentile(nsPerOp, 0.99);
+    return result;
+}
+
+string to_json(const vector<BenchResult>& results, bool verified) {
+    ostringstream o;
+    o << "{\n  \"corpus_seed\": " << CORPUS_SEED << ",\n  \"corpus_hands\": " << CORPUS_HANDS
+      << ",\n  \"solver_verified\": " << (verified ? "true" : "false")
+      << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        char line[384];
+        snprintf(line, sizeof(line),
+                 "    {\"name\": \"%s\", \"samples\": %d, \"ops_per_sample\": %llu, "
+                 "\"ns_per_op\": {\"mean\": %.2f, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f}, "
+                 "\"allocs_per_op\": %.3f}%s\n",
+                 r.name.c_str(), r.samples, (unsigned long long) r.opsPerSample,
+                 r.mean, r.p50, r.p90, r.p99, r.allocationsPerOp,
+                 i + 1 < results.size() ? "," : "");
+        o << line;
+    }
+    o << "  ]\n}\n";
+    return o.str();
+}
+
+// the exact solver must agree with the exhaustive reference on every corpus hand
+bool verify_solver(const vector<Corpus>& corpora) {
+    for (const Corpus& corpus : corpora) {
+        for (HandMask hand : corpus.masks) {
+            if (min_deadwood(hand) != min_deadwood_reference(hand)) {
+                cerr << "solver mismatch on hand";
+                for (const Card& c : to_cards(hand)) {
+                    cerr << ' ' << c;
+                }
+                cerr << '\n';
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+    The solver on hands made up for it rather than dealt for a benchmark: every size
+    from 1 to 13 cards, half of them drawn from a window of 5 ranks so that nearly
+    every card sits in a set and a run at once. min_deadwood and solve_melds must
+    both give min_deadwood_reference's deadwood, and solve_melds' melds must be real
+    candidates of the hand that don't share a card and leave exactly that deadwood.
+*/
+bool verify_solver_random(uint64 seed) {
+    Rng rng(seed);
+    for (int i = 0; i < SOLVER_RANDOM_HANDS; ++i) {
+        int handSize = 1 + i % 13;
+        int lowRank = i % 2 ? 1 + int(rng.below(9)) : 1;
+        int ranks = i % 2 ? 5 : rankcount;
+        HandMask hand = 0;
+        while (card_count(hand) < handSize) {
+            int rank = lowRank + int(rng.below(uint32(ranks)));
+            int suit = 1 + int(rng.below(suitcount));
+            hand |= HandMask(1) << ((suit - 1) * lanewidth + (rank - 1));
+        }
+
+        int expected = min_deadwood_reference(hand);
+        MeldPartition partition = solve_melds(hand);
+        HandMask candidates[max_meld_candidates];
+        int candidateCount = list_meld_candidates(hand, candidates);
+        HandMask used = 0;
+        bool valid = true;
+        for (int m = 0; m < partition.meldCount; ++m) {
+            HandMask meld = partition.melds[m];
+            valid = valid && !(used & meld) &&
+                    find(candidates, candidates + candidateCount, meld) != candidates + candidateCount;
+            used |= meld;
+        }
+        valid = valid && used == partition.melded && deadwood_value(hand & ~used) == expected;
+
+        if (min_deadwood(hand) != expected || partition.deadwood != expected || !valid) {
+            cerr << "solver mismatch on random hand";
+            for (const Card& c : to_cards(hand)) {
+                cerr << ' ' << c;
+            }
+            cerr << ": " << min_deadwood(hand) << ", partition " << partition.deadwood
+                 << " vs " << expected << '\n';
+            return false;
+        }
+    }
+    return true;
+}
+
+// same for the shoe solver, on hands with repeated cards
+bool verify_shoe_solver(const vector<ShoeCorpus>& corpora) {
+    for (const ShoeCorpus& corpus : corpora) {
+        for (const CardCounts& hand : corpus.hands) {
+            if (min_deadwood(hand) != min_deadwood_reference(hand)) {
+                cerr << "shoe solver mismatch on a " << corpus.decks << "-pack hand";
+                for (HandMask rest = hand.held(); rest; rest &= rest - 1) {
+                    cerr << ' ' << hand.count(rest & -rest) << 'x' << bit_card(__builtin_ctzll(rest));
+                }
+                cerr << '\n';
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+    One turn of a hand on its own, the way take_turn plays it minus the printing:
+    draw from the stock, look at the melds, throw the best card, check the deadwood.
+    Redeals when the stock runs out.
+*/
+int play_hand_turn(Deck& deck, IncrementalHand& hand, MeldList& sets, MeldList& runs,
+                   int handSize) {
+    if (deck.remaining() == 0) {
+        deck.new_deck();
+        hand = IncrementalHand(deck, uint8(handSize));
+    }
+    hand.add(deck.deal_card());
+    sets = hand.sets();
+    runs = hand.runs();
+
+    int deadwood;
+    Card pick = best_discard(hand.bits(), deadwood);
+    size_t index = 0;
+    while (!(hand.cards()[index] == pick)) {
+        ++index;
+    }
+    hand.remove_at(index);
+    hand.best_melds(sets, runs);
+    return hand.deadwood();
+}
+
+/*
+    A warmed-up simulation must not touch the heap: play rounds between every pair of
+    policies and a few thousand single-hand turns, and return what they allocated.
+*/
+uint64 steady_state_allocations() {
+    GameEngine engine;
+    engine.reseed(CORPUS_SEED);
+    GreedyPolicy greedy;
+    BotPolicy bot;
+    RandomPolicy random(CORPUS_SEED);
+    PlayerPolicy* policies[] = {&greedy, &bot, &random};
+
+    Deck deck{Rng(CORPUS_SEED)};
+    IncrementalHand hand(deck, standard_hand_size);
+    MeldList sets, runs;
+
+    // first use of everything (iostream buffers, lazy statics) is allowed to allocate
+    sink += engine.play_round(greedy, bot).points;
+    sink += play_hand_turn(deck, hand, sets, runs, standard_hand_size);
+
+    uint64 before = heap_allocations();
+    for (PlayerPolicy* seat0 : policies) {
+        for (PlayerPolicy* seat1 : policies) {
+            for (int r = 0; r < 200; ++r) {
+                sink += engine.play_round(*seat0, *seat1, r % 2).points;
+            }
+        }
+    }
+    for (int t = 0; t < 5000; ++t) {
+        sink += play_hand_turn(deck, hand, sets, runs, standard_hand_size);
+    }
+    return heap_allocations() - before;
+}
+
+// the hand with its suits relabelled: suit i moves to order[i]
+HandMask permute_suits(HandMask hand, const int order[suitcount]) {
+    HandMask out = 0;
+    for (int i = 0; i < suitcount; ++i) {
+        out |= ((hand >> (i * lanewidth)) & lane_ranks) << (order[i] * lanewidth);
+    }
+    return out;
+}
+
+/*
+    Every suit order of a corpus hand has to have one canonical form, and the cache
+    has to give the solver's deadwood for it, with melded cards that are in the hand
+    and leave exactly that deadwood.
+*/
+bool verify_deadwood_cache(const vector<Corpus>& corpora) {
+    DeadwoodCache cache(12);
+    for (const Corpus& corpus : corpora) {
+        for (HandMask hand : corpus.masks) {
+            HandMask canonical = canonical_hand(hand).mask;
+            int expected = min_deadwood(hand);
+            int order[suitcount] = {0, 1, 2, 3};
+            do {
+                HandMask permuted = permute_suits(hand, order);
+                int deadwood;
+                HandMask melded = cache.melded(permuted, deadwood);
+                if (canonical_hand(permuted).mask != canonical || deadwood != expected ||
+                    cache.min_deadwood(permuted) != expected || (melded & ~permuted) ||
+                    deadwood_value(permuted & ~melded) != expected) {
+                    cerr << "deadwood cache mismatch on hand";
+                    for (const Card& c : to_cards(permuted)) {
+                        cerr << ' ' << c;
+                    }
+                    cerr << '\n';
+                    return false;
+                }
+            } while (next_permutation(order, order + suitcount));
+        }
+    }
+    return true;
+}
+
+// hands whose melds overlap, the only ones that need the solver (and go through the cache)
+vector<HandMask> make_overlap_corpus(int handSize, uint64 seed) {
+    vector<HandMask> hands;
+    Deck deck{Rng(seed)};
+    while (int(hands.size()) < CORPUS_HANDS) {
+        deck.new_deck();
+        HandMask hand = deck.deal_mask(uint8(handSize)), melded;
+        if (!melds_without_overlap(hand, melded)) {
+            hands.push_back(hand);
+        }
+    }
+    return hands;
+}
+
+/*
+    Every kernel this CPU runs has to give calculate_deadwood's answer on the best
+    arrangement for every corpus hand, and say knockable exactly when that is within
+    knock_limit. The count is one short of the corpus so the scalar tail is covered.
+*/
+bool verify_batch_deadwood(const vector<Corpus>& corpora, const vector<HandMask>& overlap) {
+    vector<vector<HandMask>> batches;
+    for (const Corpus& corpus : corpora) {
+        batches.push_back(corpus.masks);
+    }
+    batches.push_back(overlap);
+    vector<BatchKernel> kernels = {BatchKernel::Scalar};
+    if (best_batch_kernel() != BatchKernel::Scalar) {
+        kernels.push_back(best_batch_kernel());
+    }
+    vector<uint16> deadwood;
+    vector<uint8> knockable;
+    for (BatchKernel kernel : kernels) {
+        for (const vector<HandMask>& hands : batches) {
+            size_t count = hands.size() - 1;
+            deadwood.assign(count, 0);
+            knockable.assign(count, 0);
+            batch_deadwood(hands.data(), count, deadwood.data(), knockable.data(), kernel);
+            for (size_t i = 0; i < count; ++i) {
+                MeldList sets, runs;
+                split_melds(solve_melds(hands[i]), sets, runs);
+                int expected = calculate_deadwood(hands[i], sets, runs);
+                if (deadwood[i] != expected || knockable[i] != (expected <= knock_limit)) {
+                    cerr << batch_kernel_name(kernel) << " batch deadwood mismatch on hand";
+                    for (const Card& c : to_cards(hands[i])) {
+                        cerr << ' ' << c;
+                    }
+                    cerr << '\n';
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// a knock to score: the knocker's hand and the defender's, from one deck
+struct KnockPosition {
+    HandMask knocker;
+    HandMask defender;
+};
+
+/*
+    Knocker hands that meld: the melds of a 13-card deal topped up to 10 cards with
+    its lowest deadwood, and 10 more cards from the same deck for the defender.
+*/
+vector<KnockPosition> make_knock_corpus(uint64 seed) {
+    vector<KnockPosition> corpus;
+    Deck deck{Rng(seed)};
+    while (int(corpus.size()) < CORPUS_HANDS) {
+        deck.new_deck();
+        HandMask dealt = deck.deal_mask(13);
+        HandMask knocker = solve_melds(dealt).melded;
+        if (!knocker || card_count(knocker) > standard_hand_size) {
+            continue;
+        }
+        for (HandMask rest = dealt & ~knocker; card_count(knocker) < standard_hand_size;
+             rest &= rest - 1) {
+            knocker |= rest & -rest;
+        }
+        corpus.push_back({knocker, deck.deal_mask(standard_hand_size)});
+    }
+    return corpus;
+}
+
+/*
+    Layoffs have to leave the defender the same deadwood as trying every card on
+    every meld in every order, and the cards said to be laid off have to leave it.
+*/
+bool verify_layoffs(const vector<KnockPosition>& corpus) {
+    for (const KnockPosition& k : corpus) {
+        MeldPartition partition = solve_melds(k.knocker);
+        LayoffResult layoff = resolve_layoffs(partition.melds, partition.meldCount, k.defender);
+        int expected = layoff_deadwood_reference(partition.melds, partition.meldCount, k.defender);
+        if (layoff.deadwood != expected || (layoff.laidOff & ~k.defender) ||
+            min_deadwood(k.defender & ~layoff.laidOff) != layoff.deadwood) {
+            cerr << "layoff mismatch, knocker";
+            for (const Card& c : to_cards(k.knocker)) {
+                cerr << ' ' << c;
+            }
+            cerr << ", defender";
+            for (const Card& c : to_cards(k.defender)) {
+                cerr << ' ' << c;
+            }
+            cerr << '\n';
+            return false;
+        }
+    }
+    return true;
+}
+
+// the session's replies up to the end of the round: go until a result comes back
+string engine_round(EngineSession& session) {
+    string replies;
+    while (replies.find("result ") == string::npos) {
+        if (replies.find("error ") != string::npos) {
+            return replies;
+        }
+        session.command("go");
+        replies += session.take_output();
+    }
+    return replies;
+}
+
+/*
+    A match played through the protocol with nothing but go has to be the match
+    GameEngine plays from the same seed: every round's result line has to say what
+    play_round returned, up to the scores.
+*/
+bool verify_engine_protocol() {
+    for (uint64 seed = CORPUS_SEED; seed < CORPUS_SEED + 20; ++seed) {
+        EngineSession session;
+        session.command("newgame seed " + to_string(seed));
+        session.take_output();
+        GameEngine engine;
+        engine.reseed(seed);
+        BotPolicy seat0, seat1;
+        for (int rounds = 0;; ++rounds) {
+            string replies = engine_round(session);
+            RoundResult r = engine.play_round(seat0, seat1, rounds % 2);
+            string expected = string("result ") + round_end_words[uint8(r.type)] + " knocker " +
+                              to_string(r.knocker) + " winner " + to_string(r.winner) +
+                              " points " + to_string(r.points) + " deadwood " +
+                              to_string(r.knockerDeadwood) + " " + to_string(r.opponentDeadwood) +
+                              " laidoff " + (r.laidOff ? mask_text(r.laidOff) : "-") + " scores ";
+            if (replies.find(expected) == string::npos) {
+                cerr << "engine protocol mismatch with seed " << seed << " round " << rounds + 1
+                     << ": expected " << expected << "\n" << replies;
+                return false;
+            }
+            if (replies.find("gameover ") != string::npos) {
+                break;
+            }
+            session.command("newround");
+            session.take_output();
+        }
+    }
+    return true;
+}
+
+// copies of the table at HAND_TABLE_PATH, each broken one way, that open() has to refuse
+bool verify_hand_table_damage() {
+    ifstream in(HAND_TABLE_PATH, ios::binary);
+    string file((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    HandValueHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    string path = string(HAND_TABLE_PATH) + ".damaged";
+
+    auto refused = [&](const char* what, size_t offset, uint32 value, size_t width) {
+        string broken = file;
+        memcpy(&broken[offset], &value, width);   // little-endian, like the file
+        ofstream(path, ios::binary) << broken;
+        HandValueTable table;
+        if (table.open(path)) {
+            cerr << "hand table with " << what << " opened\n";
+            return false;
+        }
+        return true;
+    };
+    size_t startsAt = sizeof(HandValueHeader);
+    bool ok = refused("a log2Buckets of 64", offsetof(HandValueHeader, log2Buckets), 64, 1) &&
+              refused("a handSize of 0", offsetof(HandValueHeader, handSize), 0, 1) &&
+              refused("a handSize past max_table_hand", offsetof(HandValueHeader, handSize),
+                      max_table_hand + 1, 1) &&
+              refused("a bucket start past the entries", startsAt + sizeof(uint32),
+                      header.entryCount + 1, sizeof(uint32)) &&
+              refused("bucket starts going backwards", startsAt, header.entryCount, sizeof(uint32));
+    remove(path.c_str());
+    return ok;
+}
+
+/*
+    A table of every canonical 3-card hand (two rounds each, only the lookup is being
+    checked) has to give back, for every corpus hand in whatever suits, what
+    measure_hand said about its canonical form, whatever order the hands were measured
+    in, and nothing for a hand of another size. Copies of the file with a broken
+    header or bucket starts must not open. Leaves the table at HAND_TABLE_PATH.
+*/
+bool verify_hand_values(const Corpus& corpus) {
+    const int samples = 2;
+    vector<HandMask> hands = canonical_starting_hands(corpus.handSize);
+    vector<HandValue> values(hands.size());
+    GameEngine engine(corpus.handSize), backwards(corpus.handSize);
+    BotPolicy seat0, seat1;
+    for (size_t i = 0; i < hands.size(); ++i) {
+        values[i] = measure_hand(engine, seat0, seat1, hands[i], samples, CORPUS_SEED);
+    }
+    for (size_t i = hands.size(); i-- > 0;) {
+        HandValue again = measure_hand(backwards, seat0, seat1, hands[i], samples, CORPUS_SEED);
+        if (memcmp(&again, &values[i], sizeof(again)) != 0) {
+            cerr << "hand value of " << mask_text(hands[i]) << " depends on the order measured\n";
+            return false;
+        }
+    }
+    HandValueTable table;
+    if (!write_hand_values(HAND_TABLE_PATH, corpus.handSize, samples, CORPUS_SEED, values) ||
+        !table.open(HAND_TABLE_PATH) || table.size() != hands.size()) {
+        cerr << "couldn't write and map a hand table at " << HAND_TABLE_PATH << '\n';
+        return false;
+    }
+    for (HandMask hand : corpus.masks) {
+        HandMask canonical = canonical_hand(hand).mask;
+        size_t at = lower_bound(hands.begin(), hands.end(), canonical) - hands.begin();
+        const HandValue* found = table.find(hand);
+        if (!found || memcmp(found, &values[at], sizeof(HandValue)) != 0) {
+            cerr << "hand table lookup mismatch for " << mask_text(hand) << '\n';
+            return false;
+        }
+    }
+    if (table.find(card_of_index(0) | card_of_index(1))) {
+        cerr << "hand table found a hand of the wrong size\n";
+        return false;
+    }
+    table.close();
+    return verify_hand_table_damage();
+}
+
+// a hand about to discard and the cards its player hasn't seen
+struct OutsPosition {
+    HandMask hand;
+    HandMask unseen;
+};
+
+// corpus hands with up to 20 of the other cards already seen (in the pile or known)
+vector<OutsPosition> make_outs_corpus(const Corpus& corpus, uint64 seed) {
+    Rng rng(seed);
+    vector<OutsPosition> positions;
+    for (HandMask hand : corpus.masks) {
+        HandMask unseen = all_cards & ~hand;
+        for (int seen = int(rng.below(21)); seen > 0; --seen) {
+            HandMask rest = unseen;
+            for (int skip = int(rng.below(uint32(card_count(rest)))); skip > 0; --skip) {
+                rest &= rest - 1;
+            }
+            unseen &= ~(rest & -rest);
+        }
+        positions.push_back({hand, unseen});
+    }
+    return positions;
+}
+
+// draws the kept hand can use from unseen: the least deadwood after any one throw, worked out card by card
+int outs_reference(HandMask kept, HandMask drawn) {
+    HandMask hand = kept | drawn;
+    int best = min_deadwood(kept);
+    for (HandMask rest = hand; rest; rest &= rest - 1) {
+        best = min(best, min_deadwood(hand & ~(rest & -rest)));
+    }
+    return best;
+}
+
+/*
+    Every out live_outs finds has to match throwing each card, drawing each unseen
+    card and solving every hand that leaves, and the chances have to match counting
+    every set of two draws that holds an out.
+*/
+bool verify_live_outs(const vector<OutsPosition>& positions) {
+    DiscardOuts options[default_deck];
+    for (size_t p = 0; p < positions.size(); p += 8) {
+        const OutsPosition& pos = positions[p];
+        int count = live_outs(pos.hand, pos.unseen, 2, options);
+        int unseenCount = card_count(pos.unseen);
+        for (int i = 0; i < count; ++i) {
+            HandMask kept = pos.hand & ~card_bit(options[i].discard);
+            HandMask knockOuts = 0, ginOuts = 0;
+            for (HandMask rest = pos.unseen; rest; rest &= rest - 1) {
+                int best = outs_reference(kept, rest & -rest);
+                knockOuts |= best <= knock_limit ? rest & -rest : 0;
+                ginOuts |= best == 0 ? rest & -rest : 0;
+            }
+            // of the C(unseen, 2) pairs, the ones with at least one out
+            int outCount = card_count(knockOuts);
+            double hits = double(outCount) * (unseenCount - outCount) +
+                          double(outCount) * (outCount - 1) / 2;
+            double expected = hits / (double(unseenCount) * (unseenCount - 1) / 2);
+            if (options[i].knockOuts != knockOuts || options[i].ginOuts != ginOuts ||
+                options[i].deadwood != min_deadwood(kept) ||
+                fabs(options[i].knockChance - expected) > 1e-12) {
+                cerr << "live outs mismatch throwing " << card_name(options[i].discard) << " from "
+                     << mask_text(pos.hand) << ": " << card_count(options[i].knockOuts)
+                     << " knock outs vs " << outCount << '\n';
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// reference for AceHighRanks: hand's melds found in card_bit order, runs going 2..K then A
+vector<HandMask> ace_high_melds(HandMask hand) {
+    vector<HandMask> melds;
+    for (int rank = 0; rank < rankcount; ++rank) {
+        HandMask column = hand & ((HandMask(1) << rank) * lane_repeat);
+        if (card_count(column) >= 3) {
+            melds.push_back(column);
+        }
+        if (card_count(column) == 4) {
+            for (HandMask rest = column; rest; rest &= rest - 1) {
+                melds.push_back(column & ~(rest & -rest));
+            }
+        }
+    }
+    for (int suit = 0; suit < suitcount; ++suit) {
+        for (int from = 0; from < rankcount; ++from) {
+            HandMask meld = 0;
+            for (int to = from; to < rankcount; ++to) {
+                // 2 is card_bit 1 of the lane and the ace, bit 0, comes after the king
+                HandMask bit = HandMask(1) << (suit * lanewidth + (to + 1) % rankcount);
+                if (!(hand & bit)) {
+                    break;
+                }
+                meld |= bit;
+                if (to - from >= 2) {
+                    melds.push_back(meld);
+                }
+            }
+        }
+    }
+    return melds;
+}
+
+int ace_high_reference(HandMask hand) {
+    vector<HandMask> melds = ace_high_melds(hand);
+    return min_deadwood_reference(melds.data(), int(melds.size()), 0, hand);
+}
+
+// BasicGameEngine<Rules> playing bots, with check run on every round; false once one fails
+template <class Rules, class Check>
+bool check_variant_rounds(int rounds, Check check) {
+    BasicGameEngine<Rules> engine;
+    engine.reseed(CORPUS_SEED);
+    BotPolicy seat0, seat1;
+    for (int i = 0; i < rounds; ++i) {
+        RoundResult r = engine.play_round(seat0, seat1, i % 2);
+        if (!check(r, engine.last_round())) {
+            cerr << Rules::name << " round " << i << " broke its rules: "
+                 << round_end_words[uint8(r.type)] << " knocker " << r.knocker << " points "
+                 << r.points << " deadwood " << r.knockerDeadwood << ' ' << r.opponentDeadwood
+                 << " upcard " << card_name(engine.last_round().upcard()) << '\n';
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    The rule variants: the ace-high solver has to match trying every combination of
+    ace-high melds on every corpus hand, and layoffs in that order have to leave what
+    they say they do. Bots playing each variant have to stay inside its rules:
+    nothing but gin or stock-outs in straight gin, knocks under the upcard (gin
+    only under an ace) and spades doubled in Oklahoma, and ace-high scores that
+    match the reference.
+    Standard rules are GameEngine itself, checked everywhere else.
+*/
+bool verify_rule_variants(const vector<Corpus>& corpora, const vector<KnockPosition>& knocks) {
+    for (const Corpus& corpus : corpora) {
+        for (HandMask hand : corpus.masks) {
+            HandMask layout = AceHighRanks::layout(hand);
+            if (AceHighRanks::cards(layout) != hand ||
+                min_deadwood<AceHighRanks>(layout) != ace_high_reference(hand)) {
+                cerr << "ace-high deadwood mismatch on " << mask_text(hand) << '\n';
+                return false;
+            }
+        }
+    }
+    for (const KnockPosition& k : knocks) {
+        HandMask defender = AceHighRanks::layout(k.defender);
+        LayoffResult layoff = resolve_layoffs<AceHighRanks>(AceHighRanks::layout(k.knocker), defender);
+        if ((layoff.laidOff & ~defender) ||
+            min_deadwood<AceHighRanks>(defender & ~layoff.laidOff) != layoff.deadwood ||
+            layoff.deadwood > ace_high_reference(k.defender)) {
+            cerr << "ace-high layoff mismatch, knocker " << mask_text(k.knocker) << ", defender "
+                 << mask_text(k.defender) << '\n';
+            return false;
+        }
+    }
+
+    for (uint8 suit = 1; suit <= suitcount; ++suit) {
+        Card ace = {suit, 1};
+        if (OklahomaGin::max_knock(ace) != 0) {
+            cerr << "oklahoma lets a player knock under the " << card_name(ace) << '\n';
+            return false;
+        }
+    }
+
+    const int rounds = 200;
+    int aceRounds = 0;
+    bool ok = check_variant_rounds<StraightGin>(rounds, [](const RoundResult& r,
+                                                            const BasicRound<StraightGin>&) {
+        return r.type == RoundEnd::Gin || r.type == RoundEnd::StockOut;
+    });
+    ok = ok && check_variant_rounds<OklahomaGin>(rounds, [&](const RoundResult& r,
+                                                             const BasicRound<OklahomaGin>& round) {
+        Card up = round.upcard();
+        if (up.rank == 1) {
+            ++aceRounds;
+            if (r.type == RoundEnd::Knock || r.type == RoundEnd::Undercut) {
+                return false;
+            }
+        }
+        if (r.knocker < 0) {
+            return true;
+        }
+        KnockResult base = score_knock(r.knockerDeadwood, r.opponentDeadwood);
+        return r.knockerDeadwood <= card_value(up) && base.type == r.type &&
+               r.points == base.points * (up.suit == 4 ? 2 : 1);
+    });
+    if (ok && aceRounds == 0) {
+        cerr << "oklahoma never turned up an ace to check\n";
+        return false;
+    }
+    ok = ok && check_variant_rounds<AceHighGin>(rounds, [](const RoundResult& r,
+                                                           const BasicRound<AceHighGin>& round) {
+        if (r.knocker < 0) {
+            return true;
+        }
+        HandMask defender = round.hand(1 - r.knocker);
+        return r.knockerDeadwood == ace_high_reference(round.hand(r.knocker)) &&
+               !(r.laidOff & ~defender) &&
+               r.opponentDeadwood == ace_high_reference(defender & ~r.laidOff) &&
+               r.knockerDeadwood <= knock_limit;
+    });
+    if (!ok) {
+        return false;
+    }
+
+    // ace-high has no shoe layout, so it won't deal from one
+    BasicGameEngine<AceHighGin> shoe(standard_hand_size, 2);
+    BotPolicy seat0, seat1;
+    if (shoe.play_round(seat0, seat1).type != RoundEnd::None) {
+        cerr << "ace-high dealt from a shoe\n";
+        return false;
+    }
+    return true;
+}
+
+template <class Rules>
+BenchResult variant_round(int samples) {
+    BasicGameEngine<Rules> engine;
+    engine.reseed(CORPUS_SEED);
+    BotPolicy seat0, seat1;
+    return run_bench(string("variant_round/") + Rules::name, samples, 20, [&](uint64 i) {
+        sink += engine.play_round(seat0, seat1, int(i % 2)).points;
+    });
+}
+
+// a round stopped at the draw once the stock is down to a few cards, with its own deck
+struct EndgamePosition {
+    Deck deck{Rng(0)};
+    Round round;
+};
+
+/*
+    Positions from greedy-vs-greedy rounds, stopped when the stock holds stockLeft
+    cards and a seat is about to draw. Rounds that end before that are skipped.
+*/
+vector<unique_ptr<EndgamePosition>> make_endgame_corpus(int stockLeft, int count, uint64 seed) {
+    vector<unique_ptr<EndgamePosition>> corpus;
+    GreedyPolicy greedy;
+    Card drawn;
+    for (uint64 n = 0; int(corpus.size()) < count; ++n) {
+        unique_ptr<EndgamePosition> p(new EndgamePosition);
+        p->deck.seed(mix_seed(seed + n));
+        p->deck.new_deck();
+        Round& round = p->round;
+        round.deal(p->deck, standard_hand_size, int(n % 2));
+        while (round.phase() != Round::Over &&
+               !(round.phase() == Round::Draw && round.stock_remaining() == stockLeft)) {
+            TurnView view = turn_view(round);
+            switch (round.phase()) {
+                case Round::Draw:
+                    round.draw(greedy.draw_from_discard(view), drawn);
+                    break;
+                case Round::Discard:
+                    round.discard(greedy.choose_discard(view));
+                    break;
+                default:
+                    round.knock(false);     // play on, to reach the endgame more often
+                    break;
+            }
+        }
+        if (round.phase() == Round::Draw) {
+            corpus.push_back(move(p));
+        }
+    }
+    return corpus;
+}
+
+// the position at with its stock loaded so that top (if any) is the next card dealt
+void resume_endgame(const Round& at, HandMask stock, HandMask top, Deck& deck, Round& round) {
+    const HandMask hands[2] = {at.hand(0), at.hand(1)};
+    const HandMask noPickups[2] = {0, 0};
+    Card cards[default_deck];
+    uint16 n = 0;
+    for (HandMask rest = stock & ~top; rest; rest &= rest - 1) {
+        cards[n++] = bit_card(__builtin_ctzll(rest));
+    }
+    if (top) {
+        cards[n++] = bit_card(__builtin_ctzll(top));
+    }
+    deck.load(cards, n);
+    round.resume(deck, hands, at.discard_pile(), at.discard_count(), noPickups,
+                 at.to_move(), at.turns(), at.phase());
+}
+
+// where every card is, who is to move and in which phase: what makes two positions the same
+struct LinePosition {
+    HandMask hands[2];
+    Card pile[default_deck];
+    int pileCount;
+    int toMove;
+    Round::Phase phase;
+
+    explicit LinePosition(const Round& round)
+        : hands{round.hand(0), round.hand(1)}, pileCount(round.discard_count()),
+          toMove(round.to_move()), phase(round.phase()) {
+        copy(round.discard_pile(), round.discard_pile() + pileCount, pile);
+    }
+
+    bool operator==(const LinePosition& other) const {
+        return hands[0] == other.hands[0] && hands[1] == other.hands[1] &&
+               toMove == other.toMove && phase == other.phase &&
+               pileCount == other.pileCount && equal(pile, pile + pileCount, other.pile);
+    }
+};
+
+constexpr double endgame_unbounded = numeric_limits<double>::infinity();
+
+double endgame_reference(const Round& at, HandMask stock, vector<LinePosition>& line,
+                         double alpha, double beta);
+
+/*
+    Reference for the endgame solver: seat 0's expected points after one move, by
+    plain alpha-beta with no table. Every line is played on a copy of the Round, and
+    a stock draw is made by loading the drawn card on top of the rest. line holds the
+    positions since the last stock draw; coming back to one of them is a draw.
+*/
+double endgame_reference_move(const Round& at, HandMask stock, vector<LinePosition>& line,
+                              int action, double alpha, double beta) {
+    Deck deck{Rng(0)};
+    Round round;
+    Card drawn;
+    auto next = [&](HandMask left, vector<LinePosition>& after, double a, double b) {
+        if (round.phase() == Round::Over) {
+            const RoundResult& r = round.result();
+            return r.winner < 0 ? 0.0 : r.winner == 0 ? double(r.points) : -double(r.points);
+        }
+        return endgame_reference(round, left, after, a, b);
+    };
+
+    if (action == ActDrawStock) {
+        double total = 0;
+        for (HandMask rest = stock; rest; rest &= rest - 1) {
+            HandMask bit = rest & -rest;
+            resume_endgame(at, stock, bit, deck, round);
+            round.draw(false, drawn);
+            vector<LinePosition> fresh;
+            total += next(stock & ~bit, fresh, -endgame_unbounded, endgame_unbounded);
+        }
+        return total / card_count(stock);
+    }
+    resume_endgame(at, stock, 0, deck, round);
+    if (action == ActDrawDiscard) {
+        round.draw(true, drawn);
+    } else if (action == ActPlayOn || action == ActKnock) {
+        round.knock(action == ActKnock);
+    } else {
+        round.discard(bit_card(action - ActDiscard));
+    }
+    return next(stock, line, alpha, beta);
+}
+
+// seat 0's expected points from at, with the mover taking its best move (exact inside (alpha, beta))
+double endgame_reference(const Round& at, HandMask stock, vector<LinePosition>& line,
+                         double alpha, double beta) {
+    LinePosition here(at);
+    if (find(line.begin(), line.end(), here) != line.end()) {
+        return 0;
+    }
+    ActionSet moves;
+    switch (at.phase()) {
+        case Round::Draw:
+            moves.add(ActDrawStock);
+            if (at.has_discard()) {
+                moves.add(ActDrawDiscard);
+            }
+            break;
+        case Round::Discard:
+            for (HandMask rest = at.hand(at.to_move()); rest; rest &= rest - 1) {
+                moves.add(ActDiscard + __builtin_ctzll(rest));
+            }
+            break;
+        case Round::Knock:
+            moves.add(ActPlayOn);
+            moves.add(ActKnock);
+            break;
+        case Round::Over:
+            return 0;
+    }
+    line.push_back(here);
+    bool maximise = at.to_move() == 0;
+    double best = maximise ? -endgame_unbounded : endgame_unbounded;
+    for (int i = 0; i < moves.count() && alpha < beta; ++i) {
+        double v = endgame_reference_move(at, stock, line, moves.nth(i), alpha, beta);
+        if (maximise) {
+            best = max(best, v);
+            alpha = max(alpha, best);
+        } else {
+            best = min(best, v);
+            beta = min(beta, best);
+        }
+    }
+    line.pop_back();
+    return best;
+}
+
+HandMask stock_of(const Round& round) {
+    HandMask seen = round.hand(0) | round.hand(1);
+    for (int i = 0; i < round.discard_count(); ++i) {
+        seen |= card_bit(round.discard_pile()[i]);
+    }
+    return all_cards & ~seen;
+}
+
+// every option from round must match the reference (up to rounding), and the threaded solve exactly
+bool check_endgame(EndgameSolver& serial, EndgameSolver& threaded, const Round& round) {
+    EndgameOption options[default_deck + 1], again[default_deck + 1];
+    int count = serial.solve(round, options);
+    if (count == 0 || count != threaded.solve(round, again)) {
+        cerr << "endgame solver gave no options\n";
+        return false;
+    }
+    double sign = round.to_move() == 0 ? 1 : -1;
+    for (int i = 0; i < count; ++i) {
+        vector<LinePosition> line{LinePosition(round)};
+        double expected = sign * endgame_reference_move(round, stock_of(round), line,
+                                                        options[i].action, -endgame_unbounded,
+                                                        endgame_unbounded);
+        if (fabs(options[i].value - expected) > 1e-9 ||
+            options[i].action != again[i].action || options[i].value != again[i].value) {
+            cerr << "endgame solver mismatch with " << round.stock_remaining()
+                 << " cards in the stock: " << options[i].value << " vs " << expected
+                 << " (threaded " << again[i].value << ")\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    From the draw and from the discard after taking the pile, the solver must match
+    the reference on small endgames, and solving on every core (one shared table)
+    must give exactly the values of one thread.
+*/
+bool verify_endgame_solver() {
+    EndgameTable serialTable(20), threadedTable(20);
+    EndgameSolver serial(serialTable, 1), threaded(threadedTable, 0);
+    for (int stockLeft = 1; stockLeft <= 2; ++stockLeft) {
+        for (auto& p : make_endgame_corpus(stockLeft, 10, CORPUS_SEED + stockLeft)) {
+            Round taken = p->round;
+            Card drawn;
+            taken.draw(true, drawn);
+            if (!check_endgame(serial, threaded, p->round) ||
+                !check_endgame(serial, threaded, taken)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, const char * argv[]) {
+    string outPath, filter;
+    int samples = 200;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--quick") {
+            samples = 20;
+        } else {
+            cerr << "usage: bench [--out file.json] [--filter text] [--quick]\n";
+            return 1;
+        }
+    }
+
+    vector<Corpus> corpora;
+    for (int size : HAND_SIZES) {
+        corpora.push_back(make_corpus(size, CORPUS_SEED + size));
+    }
+
+    vector<ShoeCorpus> shoes;
+    for (int decks : SHOE_DECKS) {
+        shoes.push_back(make_shoe_corpus(decks, CORPUS_SEED + 100 + decks));
+    }
+
+    vector<KnockPosition> knocks = make_knock_corpus(CORPUS_SEED + 400);
+    vector<HandMask> overlap = make_overlap_corpus(11, CORPUS_SEED + 300);
+    vector<OutsPosition> outsPositions = make_outs_corpus(corpora.back(), CORPUS_SEED + 500);
+
+    bool verified = verify_solver(corpora) && verify_solver_random(CORPUS_SEED + 600) &&
+                    verify_shoe_solver(shoes) &&
+                    verify_deadwood_cache(corpora) && verify_batch_deadwood(corpora, overlap) &&
+                    verify_layoffs(knocks) && verify_engine_protocol() &&
+                    verify_hand_values(corpora[0]) && verify_live_outs(outsPositions) &&
+                    verify_rule_variants(corpora, knocks) && verify_endgame_solver();
+    if (!verified) {
+        return 1;
+    }
+    uint64 steadyAllocations = steady_state_allocations();
+    if (steadyAllocations != 0) {
+        cerr << "simulated rounds made " << steadyAllocations << " heap allocations\n";
+        return 1;
+    }
+
+    vector<BenchResult> results;
+    auto wanted = [&](const string& name) {
+        return filter.empty() || name.find(filter) != string::npos;
+    };
+    const uint64 kernelOps = CORPUS_HANDS;
+    vector<BatchKernel> batchKernels = {BatchKernel::Scalar};
+    if (best_batch_kernel() != BatchKernel::Scalar) {
+        batchKernels.push_back(best_batch_kernel());
+    }
+
+    for (const Corpus& c : corpora) {
+        string size = "/" + to_string(c.handSize);
+        if (wanted("find_sets" + size)) {
+            results.push_back(run_bench("find_sets" + size, samples, kernelOps, [&](uint64 i) {
+                sink += find_sets(c.hands[i % CORPUS_HANDS]).size();
+            }));
+        }
+        if (wanted("find_runs" + size)) {
+            results.push_back(run_bench("find_runs" + size, samples, kernelOps, [&](uint64 i) {
+                sink += find_runs(c.hands[i % CORPUS_HANDS]).size();
+            }));
+        }
+        if (wanted("calculate_deadwood" + size)) {
+            results.push_back(run_bench("calculate_deadwood" + size, samples, kernelOps, [&](uint64 i) {
+                size_t k = i % CORPUS_HANDS;
+                sink += calculate_deadwood(c.hands[k], c.sets[k], c.runs[k]);
+            }));
+        }
+        if (wanted("min_deadwood" + size)) {
+            results.push_back(run_bench("min_deadwood" + size, samples, kernelOps, [&](uint64 i) {
+                sink += min_deadwood(c.masks[i % CORPUS_HANDS]);
+            }));
+        }
+        // the whole corpus in one call per pass, timed per hand, with each kernel
+        for (BatchKernel kernel : batchKernels) {
+            string name = string("batch_deadwood_") + batch_kernel_name(kernel) + size;
+            if (!wanted(name)) {
+                continue;
+            }
+            vector<uint16> deadwood(CORPUS_HANDS);
+            vector<uint8> knockable(CORPUS_HANDS);
+            results.push_back(run_bench(name, samples, kernelOps, [&](uint64 i) {
+                if (i % CORPUS_HANDS == 0) {
+                    batch_deadwood(c.masks.data(), CORPUS_HANDS, deadwood.data(),
+                                   knockable.data(), kernel);
+                    sink += deadwood[i % 7] + knockable[i % 5];
+                }
+            }));
+        }
+    }
+
+    for (const ShoeCorpus& c : shoes) {
+        string name = "min_deadwood_shoe/" + to_string(c.decks);
+        if (wanted(name)) {
+            results.push_back(run_bench(name, samples, kernelOps, [&](uint64 i) {
+                sink += min_deadwood(c.hands[i % CORPUS_HANDS]);
+            }));
+        }
+    }
+
+    // the solver against the cache on the hands that need it; the cache is warm after
+    // run_bench's first sample, so this times hits
+    if (wanted("overlap")) {
+        DeadwoodCache cache(16);
+        results.push_back(run_bench("min_deadwood_overlap/11", samples, kernelOps, [&](uint64 i) {
+            sink += min_deadwood(overlap[i % CORPUS_HANDS]);
+        }));
+        results.push_back(run_bench("cached_deadwood_overlap/11", samples, kernelOps, [&](uint64 i) {
+            sink += cache.min_deadwood(overlap[i % CORPUS_HANDS]);
+        }));
+    }
+
+    srand(1);
+    legacy::Deck oldDeck;
+    Deck newDeck{Rng(CORPUS_SEED)};
+    const uint64 deckOps = 1000;
+
+    // scoring a knock: the defender's best layoffs and what they leave
+    if (wanted("resolve_layoffs")) {
+        results.push_back(run_bench("resolve_layoffs", samples, kernelOps, [&](uint64 i) {
+            const KnockPosition& k = knocks[i % CORPUS_HANDS];
+            sink += resolve_layoffs(k.knocker, k.defender).deadwood;
+        }));
+    }
+    // every throw of an 11-card hand with its outs and chances three draws out
+    if (wanted("live_outs")) {
+        DiscardOuts options[default_deck];
+        results.push_back(run_bench("live_outs/11", samples, 200, [&](uint64 i) {
+            const OutsPosition& pos = outsPositions[i % outsPositions.size()];
+            sink += live_outs(pos.hand, pos.unseen, outs_draws, options);
+        }));
+    }
+    // an opening hand's value out of the mapped table, suits canonicalized on the way
+    if (wanted("hand_value_lookup")) {
+        HandValueTable table;
+        table.open(HAND_TABLE_PATH);
+        const Corpus& corpus = corpora[0];
+        results.push_back(run_bench("hand_value_lookup/" + to_string(corpus.handSize), samples,
+                                    kernelOps, [&](uint64 i) {
+            sink += table.find(corpus.masks[i % CORPUS_HANDS])->winRate;
+        }));
+    }
+    if (wanted("legacy_shuffle")) {
+        results.push_back(run_bench("legacy_shuffle", samples, deckOps, [&](uint64) {
+            oldDeck.create_deck();
+            oldDeck.shuffle_deck();
+            sink += oldDeck.remaining();
+        }));
+    }
+    if (wanted("shuffle_deck")) {
+        results.push_back(run_bench("shuffle_deck", samples, deckOps, [&](uint64) {
+            newDeck.create_deck();
+            newDeck.shuffle_deck();
+            sink += newDeck.remaining();
+        }));
+    }
+    for (int size : HAND_SIZES) {
+        string name = "deal_hand/" + to_string(size);
+        if (wanted("legacy_" + name)) {
+            results.push_back(run_bench("legacy_" + name, samples, deckOps, [&](uint64) {
+                oldDeck.create_deck();
+                sink += oldDeck.deal_hand(size).size() + oldDeck.deal_hand(size).size();
+            }));
+        }
+        if (wanted(name)) {
+            results.push_back(run_bench(name, samples, deckOps, [&](uint64) {
+                CardPile hands[2];
+                newDeck.create_deck();
+                newDeck.deal_hand(hands[0], uint8(size));
+                newDeck.deal_hand(hands[1], uint8(size));
+                sink += hands[0].size() + hands[1].size();
+            }));
+        }
+    }
+
+    // a whole headless round: shuffle, deal, play to a knock or stock-out, score
+    if (wanted("headless_round")) {
+        GameEngine engine;
+        engine.reseed(CORPUS_SEED);
+        GreedyPolicy seat0, seat1;
+        results.push_back(run_bench("headless_round", samples, 20, [&](uint64 i) {
+            sink += engine.play_round(seat0, seat1, int(i % 2)).points;
+        }));
+    }
+    if (wanted("shoe_round")) {
+        GameEngine engine(standard_hand_size, 2);
+        engine.reseed(CORPUS_SEED);
+        GreedyPolicy seat0, seat1;
+        results.push_back(run_bench("shoe_round/2", samples, 20, [&](uint64 i) {
+            sink += engine.play_round(seat0, seat1, int(i % 2)).points;
+        }));
+    }
+    if (wanted("bot_round")) {
+        GameEngine engine;
+        engine.reseed(CORPUS_SEED);
+        BotPolicy seat0, seat1;
+        results.push_back(run_bench("bot_round", samples, 20, [&](uint64 i) {
+            sink += engine.play_round(seat0, seat1, int(i % 2)).points;
+        }));
+    }
+    if (wanted("bot_round_cached")) {
+        GameEngine engine;
+        engine.reseed(CORPUS_SEED);
+        DeadwoodCache cache(16);
+        engine.use_cache(&cache);
+        BotPolicy seat0(&cache), seat1(&cache);
+        results.push_back(run_bench("bot_round_cached", samples, 20, [&](uint64 i) {
+            sink += engine.play_round(seat0, seat1, int(i % 2)).points;
+        }));
+    }
+    // bot_round under each rule variant, every one compiled with its rules folded in
+    if (wanted("variant_round")) {
+        results.push_back(variant_round<StandardGin>(samples));
+        results.push_back(variant_round<StraightGin>(samples));
+        results.push_back(variant_round<OklahomaGin>(samples));
+        results.push_back(variant_round<AceHighGin>(samples));
+    }
+    // the same bot round driven through the text protocol, parsing and replies included
+    if (wanted("engine_protocol_round")) {
+        EngineSession session;
+        session.command("newgame seed " + to_string(CORPUS_SEED));
+        session.take_output();
+        results.push_back(run_bench("engine_protocol_round", samples, 20, [&](uint64) {
+            string replies = engine_round(session);
+            sink += replies.size();
+            session.command(replies.find("gameover ") == string::npos ? "newround" : "newgame");
+            sink += session.take_output().size();
+        }));
+    }
+    if (wanted("hand_turn")) {
+        Deck deck{Rng(CORPUS_SEED)};
+        IncrementalHand hand(deck, standard_hand_size);
+        MeldList sets, runs;
+        results.push_back(run_bench("hand_turn/10", samples, 1000, [&](uint64) {
+            sink += play_hand_turn(deck, hand, sets, runs, standard_hand_size);
+        }));
+    }
+
+    // an exact endgame solve from the draw, on a fresh table each time so every op
+    // does the whole search: one thread, then every core sharing the table
+    for (int stockLeft = 2; stockLeft <= endgame_max_stock; ++stockLeft) {
+        for (unsigned threads : {1u, 0u}) {
+            string name = string(threads == 1 ? "endgame_solve/" : "endgame_solve_mt/") +
+                          to_string(stockLeft);
+            if (!wanted(name)) {
+                continue;
+            }
+            auto positions = make_endgame_corpus(stockLeft, 8, CORPUS_SEED + 200 + stockLeft);
+            EndgameTable table(20);
+            EndgameSolver solver(table, threads);
+            EndgameOption options[default_deck + 1];
+            results.push_back(run_bench(name, max(samples / 20, 3), 1, [&](uint64 i) {
+                table.clear();
+                sink += solver.solve(positions[i % positions.size()]->round, options);
+            }));
+        }
+    }
+
+    string json = to_json(results, verified);
+    if (outPath.empty()) {
+        cout << json;
+    } else {
+        ofstream(outPath) << json;
+        cerr << "wrote " << results.size() << " benchmarks to " << outPath << '\n';
+    }
+
+    return 0;
+}
@@ -0,0 +1,971 @@
+#ifndef card_utils_h
+#define card_utils_h
+
+#include "deck.h"
+#include "batch_kernel.h"
+#include "metrics.h"
+#include <cstring>
+#include <vector>
+
+constexpr int max_melds = default_deck / 3; // no arrangement can hold more melds than this
+
+/*
+    A list of melds, each one a HandMask of its cards, with fixed storage so listing
+    melds never allocates. Holds every set of a hand (one per rank, at most 13) or
+    every maximal run (at most 3 per suit).
+*/
+struct MeldList {
+    uint8 count = 0;
+    HandMask melds[max_melds];
+
+    uint8 size() const { return count; }
+    bool empty() const { return count == 0; }
+    void push_back(HandMask meld) { melds[count++] = meld; }
+    HandMask operator[](size_t index) const { return melds[index]; }
+    const HandMask* begin() const { return melds; }
+    const HandMask* end() const { return melds + count; }
+};
+
+/*
+    A set in Gin Rummy is a list of 3+ cards with the same rank, but different suits
+    eg. 3S, 3D, 3H
+*/
+inline MeldList find_sets(HandMask handMask) {
+    metrics::PhaseTimer timer(metrics::Phase::FindSets);
+    MeldList sets;
+
+    // each bit of setRanks is a rank held in 3 or 4 suits, the set is that rank's column
+    for (HandMask setRanks = set_ranks(handMask); setRanks; setRanks &= setRanks - 1) {
+        sets.push_back(handMask & ((setRanks & -setRanks) * lane_repeat));
+    }
+
+    return sets;
+}
+
+inline MeldList find_sets(const std::vector<Card>& hand) {
+    return find_sets(to_mask(hand));
+}
+
+/*
+    A run in Gin Rummy is a list of 3+ cards with the same suit, but consecutive ranks
+    eg. AS, 2S, 3S
+
+    add_runs appends them to runs, so the multi-pack find_runs can list every layer
+    into one list and still count as one call.
+*/
+inline void add_runs(HandMask handMask, MeldList& runs) {
+    for (uint8 suit = 1; suit <= suitcount; ++suit) {
+        // the runs of every 13-bit suit pattern are precomputed in deck.h
+        const SuitRuns& lane = suit_runs.pattern[suit_lane(handMask, suit)];
+
+        for (int r = 0; r < lane.count; r++) {
+            runs.push_back(((HandMask(1) << lane.length(r)) - 1)
+                           << ((suit - 1) * lanewidth + lane.start(r)));
+        }
+    }
+}
+
+inline MeldList find_runs(HandMask handMask) {
+    metrics::PhaseTimer timer(metrics::Phase::FindRuns);
+    MeldList runs;
+    add_runs(handMask, runs);
+    return runs;
+}
+
+inline MeldList find_runs(const std::vector<Card>& hand) {
+    return find_runs(to_mask(hand));
+}
+
+inline int calculate_deadwood(HandMask hand, const MeldList& sets, const MeldList& runs) {
+    metrics::PhaseTimer timer(metrics::Phase::CalculateDeadwood);
+    // collect all cards that are in melds
+    HandMask meldedCards = 0;
+
+    for (HandMask meld : sets) {
+        meldedCards |= meld;
+    }
+
+    for (HandMask meld : runs) {
+        meldedCards |= meld;
+    }
+
+    // calculate points for unmelded cards
+    return deadwood_value(hand & ~meldedCards);
+}
+
+inline int calculate_deadwood(const std::vector<Card>& hand, const MeldList& sets,
+                              const MeldList& runs) {
+    return calculate_deadwood(to_mask(hand), sets, runs);
+}
+
+/*
+    Exact meld arrangement.
+
+    find_sets/find_runs list every meld in a hand, and those melds can share cards
+    (7S might be in 7S 7D 7H and in 5S 6S 7S). A real arrangement has to pick melds
+    that don't overlap, and the one that leaves the least deadwood is the score.
+*/
+
+// worst case is a full deck: 66 sub-runs per suit + 5 sets per rank
+constexpr int max_meld_candidates = suitcount * 66 + rankcount * 5;
+
+struct MeldPartition {
+    int deadwood = 0;
+    HandMask melded = 0;   // every card used by a meld
+    uint8 meldCount = 0;
+    HandMask melds[max_melds];
+};
+
+// a meld is a run if all of its cards are in one suit lane
+inline bool meld_is_run(HandMask meld) {
+    for (uint8 suit = 1; suit <= suitcount; ++suit) {
+        if (meld == suit_lane(meld, suit) << ((suit - 1) * lanewidth)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    Every meld the hand could use: each set of 3 or 4 (so a 4-of-a-kind also gives its
+    four 3-card subsets) and every run of 3+ inside each maximal run.
+    Returns how many were written to out.
+*/
+inline int list_meld_candidates(HandMask hand, HandMask* out) {
+    int count = 0;
+
+    HandMask setRanks = set_ranks(hand);
+    while (setRanks) {
+        int rankBit = __builtin_ctzll(setRanks);
+        setRanks &= setRanks - 1;
+
+        const RankSets& column = rank_sets.pattern[rank_column(hand, rankBit)];
+        for (int i = 0; i < column.count; ++i) {
+            out[count++] = column.sets[i] << rankBit;
+        }
+    }
+
+    for (uint8 suit = 1; suit <= suitcount; ++suit) {
+        const SuitRuns& lane = suit_runs.pattern[suit_lane(hand, suit)];
+        int shift = (suit - 1) * lanewidth;
+
+        // longest first, so the solver tends to find a zero-deadwood arrangement early
+        for (int r = 0; r < lane.count; ++r) {
+            int start = lane.start(r);
+            int length = lane.length(r);
+            for (int from = 0; from + 3 <= length; ++from) {
+                for (int to = length; to >= from + 3; --to) {
+                    out[count++] = ((HandMask(1) << (to - from)) - 1) << (shift + start + from);
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+/*
+    When no card is in both a set and a run, every candidate meld can be used at once
+    (4-sets whole, runs at full length), so the deadwood is just what's left over and
+    no search is needed. This is the common case for dealt hands.
+    Returns false if there is an overlap to resolve.
+*/
+inline bool melds_without_overlap(HandMask hand, HandMask& melded) {
+    HandMask sets = set_cards(hand);
+    HandMask runs = run_cards(hand);
+    melded = sets | runs;
+    return (sets & runs) == 0;
+}
+
+/*
+    Branch on the lowest card left: it is either deadwood or part of one of the melds
+    that contain it. Cards no remaining meld can reach are counted straight away, so
+    most branches end after one or two steps, and a small direct-mapped memo catches
+    the sub-hands that come up through different orderings.
+
+    Ranks is the rank order the hand is laid out in (deck.h), only needed for values;
+    MeldSolver is the usual ace-low one.
+*/
+template <class Ranks>
+class RankedMeldSolver
+{
+private:
+    static constexpr int memoSize = 32;
+
+    int candidateCount = 0;
+    HandMask candidates[max_meld_candidates];
+    HandMask memoKey[memoSize];
+    uint16 memoValue[memoSize];
+
+    static int memo_slot(HandMask m) {
+        return int((m * 0x9E3779B97F4A7C15ULL) >> 59);
+    }
+
+    // strip the cards no remaining meld can use, adding their value to dead
+    HandMask reachable(HandMask rem, int& dead) const {
+        HandMask meldable = 0;
+        for (int i = 0; i < candidateCount; ++i) {
+            if ((candidates[i] & rem) == candidates[i]) {
+                meldable |= candidates[i];
+            }
+        }
+        dead += Ranks::deadwood(rem & ~meldable);
+        return rem & meldable;
+    }
+
+    int solve(HandMask rem) {
+        int dead = 0;
+        rem = reachable(rem, dead);
+        if (rem == 0) {
+            return dead;
+        }
+
+        int slot = memo_slot(rem);
+        if (memoKey[slot] == rem) {
+            return dead + memoValue[slot];
+        }
+
+        HandMask low = rem & -rem;
+        int lowValue = Ranks::deadwood(low);
+        int best = Ranks::deadwood(rem);
+
+        // option 1: it goes into one of its melds, stop as soon as nothing is left over
+        for (int i = 0; i < candidateCount && best > 0; ++i) {
+            HandMask meld = candidates[i];
+            if ((meld & low) && (meld & rem) == meld) {
+                int value = solve(rem & ~meld);
+                if (value < best) {
+                    best = value;
+                }
+            }
+        }
+
+        // option 2: the lowest card is deadwood, only worth a look if it could still win
+        if (lowValue < best) {
+            int value = lowValue + solve(rem & ~low);
+            if (value < best) {
+                best = value;
+            }
+        }
+
+        memoKey[slot] = rem;
+        memoValue[slot] = uint16(best);
+        return dead + best;
+    }
+
+public:
+    explicit RankedMeldSolver(HandMask hand) {
+        candidateCount = list_meld_candidates(hand, candidates);
+        std::memset(memoKey, 0, sizeof(memoKey));
+    }
+
+    // reuse a bigger hand's candidate list, keeping only the melds that avoid excluded
+    // (the candidates of hand minus a card are exactly those that don't use it)
+    RankedMeldSolver(const HandMask* list, int count, HandMask excluded) {
+        for (int i = 0; i < count; ++i) {
+            if (!(list[i] & excluded)) {
+                candidates[candidateCount++] = list[i];
+            }
+        }
+        std::memset(memoKey, 0, sizeof(memoKey));
+    }
+
+    int min_deadwood(HandMask hand) {
+        if (candidateCount == 0) {
+            return Ranks::deadwood(hand);
+        }
+        return solve(hand);
+    }
+
+    // the arrangement itself: re-walk the choices, the memo makes this cheap
+    MeldPartition partition(HandMask hand) {
+        MeldPartition result;
+        result.deadwood = min_deadwood(hand);
+
+        HandMask rem = hand;
+        int target = result.deadwood;
+        while (true) {
+            int dead = 0;
+            rem = reachable(rem, dead);
+            target -= dead;
+            if (rem == 0) {
+                break;
+            }
+
+            HandMask low = rem & -rem;
+            int deadwoodLeft = Ranks::deadwood(low) + solve(rem & ~low);
+            if (deadwoodLeft == target) {
+                target -= Ranks::deadwood(low);
+                rem &= ~low;
+                continue;
+            }
+
+            for (int i = 0; i < candidateCount; ++i) {
+                HandMask meld = candidates[i];
+                if ((meld & low) && (meld & rem) == meld && solve(rem & ~meld) == target) {
+                    result.melds[result.meldCount++] = meld;
+                    result.melded |= meld;
+                    rem &= ~meld;
+                    break;
+                }
+            }
+        }
+
+        return result;
+    }
+};
+
+typedef RankedMeldSolver<AceLowRanks> MeldSolver;
+
+// hand laid out in Ranks' order; min_deadwood<AceLowRanks> is min_deadwood
+template <class Ranks>
+inline int min_deadwood(HandMask hand) {
+    metrics::PhaseTimer timer(metrics::Phase::MinDeadwood);
+    HandMask melded;
+    if (melds_without_overlap(hand, melded)) {
+        return Ranks::deadwood(hand & ~melded);
+    }
+    RankedMeldSolver<Ranks> solver(hand);
+    return solver.min_deadwood(hand);
+}
+
+inline int min_deadwood(HandMask hand) {
+    return min_deadwood<AceLowRanks>(hand);
+}
+
+inline int min_deadwood(const std::vector<Card>& hand) {
+    return min_deadwood(to_mask(hand));
+}
+
+template <class Ranks>
+inline MeldPartition solve_melds(HandMask hand) {
+    metrics::PhaseTimer timer(metrics::Phase::SolveMelds);
+    HandMask melded;
+    if (!melds_without_overlap(hand, melded)) {
+        RankedMeldSolver<Ranks> solver(hand);
+        return solver.partition(hand);
+    }
+
+    // no overlap: each set rank is one meld and each maximal run is one meld
+    MeldPartition result;
+    result.melded = melded;
+    result.deadwood = Ranks::deadwood(hand & ~melded);
+    for (HandMask setRanks = set_ranks(hand); setRanks; setRanks &= setRanks - 1) {
+        HandMask column = (setRanks & -setRanks) * lane_repeat;
+        result.melds[result.meldCount++] = hand & column;
+    }
+    for (uint8 suit = 1; suit <= suitcount; ++suit) {
+        const SuitRuns& lane = suit_runs.pattern[suit_lane(hand, suit)];
+        for (int r = 0; r < lane.count; ++r) {
+            result.melds[result.meldCount++] =
+                ((HandMask(1) << lane.length(r)) - 1) << ((suit - 1) * lanewidth + lane.start(r));
+        }
+    }
+    return result;
+}
+
+inline MeldPartition solve_melds(HandMask hand) {
+    return solve_melds<AceLowRanks>(hand);
+}
+
+// cards one draw away from a meld: same suit within 2 ranks, or same rank
+inline HandMask near_meld_cards(HandMask hand) {
+    // lanes have 3 spare bits, so shifts of 1 or 2 only ever spill into padding
+    HandMask runNeighbours = ((hand << 1) | (hand >> 1) | (hand << 2) | (hand >> 2)) & all_cards;
+    // rotating by whole lanes lines each card up with the same rank in the other suits
+    HandMask rankNeighbours = (hand << 16 | hand >> 48) | (hand << 32 | hand >> 32) | (hand << 48 | hand >> 16);
+    return runNeighbours | rankNeighbours;
+}
+
+// how many cards outside every meld are still one card short of one
+inline int meld_potential(HandMask hand) {
+    HandMask loose = hand & ~(set_cards(hand) | run_cards(hand));
+    return card_count(loose & near_meld_cards(hand));
+}
+
+struct DiscardChoice {
+    Card card;
+    int deadwood;   // least deadwood left after throwing it
+    int potential;  // meld_potential of what's left
+};
+
+/*
+    Anything that can answer min_deadwood in place of the solver, eg. the cache of
+    solved hands in deadwood_cache.h. The discard scoring below hands it the hands
+    whose melds overlap, which are the ones that need the solver.
+*/
+class DeadwoodLookup
+{
+public:
+    virtual ~DeadwoodLookup() {}
+    virtual int min_deadwood(HandMask hand) = 0;
+};
+
+/*
+    Scores every possible discard from hand in one go (11 for a normal turn) and
+    returns how many were written to out. With a lookup, the hands that need the
+    solver are asked of it instead.
+
+    The candidate melds are listed once and shared: a card in no candidate meld is
+    deadwood in every arrangement, so throwing it just takes its value off the hand's
+    deadwood; only cards that can meld need a solver, and that solver starts from
+    the shared list. The hands left after each throw go through meld_free_deadwood
+    first, so those with no overlap (most of them) are scored by the batch kernel,
+    four at a time with AVX2, and only the rest reach the lookup or the solver.
+*/
+inline int evaluate_discards(HandMask hand, DiscardChoice* out, DeadwoodLookup* lookup = nullptr) {
+    metrics::PhaseTimer timer(metrics::Phase::EvaluateDiscards);
+    HandMask candidates[max_meld_candidates];
+    int candidateCount = list_meld_candidates(hand, candidates);
+
+    HandMask meldable = 0;
+    for (int i = 0; i < candidateCount; ++i) {
+        meldable |= candidates[i];
+    }
+
+    HandMask cardBits[default_deck];
+    HandMask after[default_deck];
+    uint16 meldFree[default_deck];
+    int count = 0;
+    for (HandMask rest = hand; rest; rest &= rest - 1) {
+        cardBits[count++] = rest & -rest;
+    }
+
+    // padded with empty hands to whole steps of 4 (default_deck is a multiple of 4)
+    int padded = (count + 3) & ~3;
+    for (int i = 0; i < count; ++i) {
+        after[i] = hand & ~cardBits[i];
+    }
+    for (int i = count; i < padded; ++i) {
+        after[i] = 0;
+    }
+    meld_free_deadwood(after, size_t(padded), meldFree);
+
+    int handDeadwood = 0;
+    if (meldable != hand) {
+        handDeadwood = lookup ? lookup->min_deadwood(hand) : min_deadwood(hand);
+    }
+
+    for (int i = 0; i < count; ++i) {
+        out[i].card = bit_card(__builtin_ctzll(cardBits[i]));
+        out[i].potential = meld_potential(after[i]);
+        if (meldFree[i] != overlapping_melds) {
+            out[i].deadwood = meldFree[i];
+        } else if ((cardBits[i] & meldable) && lookup) {
+            out[i].deadwood = lookup->min_deadwood(after[i]);
+        } else if (cardBits[i] & meldable) {
+            MeldSolver solver(candidates, candidateCount, cardBits[i]);
+            out[i].deadwood = solver.min_deadwood(after[i]);
+        } else {
+            out[i].deadwood = handDeadwood - deadwood_value(cardBits[i]);
+        }
+    }
+
+    return count;
+}
+
+/*
+    The discard that leaves the least deadwood, ties going to the higher-value card
+    (it costs more if the opponent knocks). deadwoodAfter gets the resulting deadwood.
+*/
+inline Card best_discard(HandMask hand, int& deadwoodAfter, DeadwoodLookup* lookup = nullptr) {
+    DiscardChoice choices[default_deck];
+    int count = evaluate_discards(hand, choices, lookup);
+
+    int best = 0;
+    for (int i = 1; i < count; ++i) {
+        if (choices[i].deadwood < choices[best].deadwood ||
+            (choices[i].deadwood == choices[best].deadwood &&
+             card_value(choices[i].card) > card_value(choices[best].card))) {
+            best = i;
+        }
+    }
+
+    deadwoodAfter = choices[best].deadwood;
+    return choices[best].card;
+}
+
+/*
+    Reference answer for checking the solver: try every combination of
+    non-overlapping candidate melds. Exponential, only use it on small hands.
+*/
+inline int min_deadwood_reference(const HandMask* candidates, int count, int index,
+                                  HandMask rem) {
+    if (index == count) {
+        return deadwood_value(rem);
+    }
+    // skip this meld
+    int best = min_deadwood_reference(candidates, count, index + 1, rem);
+    // or use it, if all of its cards are still free
+    if ((candidates[index] & rem) == candidates[index]) {
+        int value = min_deadwood_reference(candidates, count, index + 1,
+                                           rem & ~candidates[index]);
+        if (value < best) {
+            best = value;
+        }
+    }
+    return best;
+}
+
+inline int min_deadwood_reference(HandMask hand) {
+    std::vector<HandMask> candidates(max_meld_candidates);
+    int count = list_meld_candidates(hand, candidates.data());
+    return min_deadwood_reference(candidates.data(), count, 0, hand);
+}
+
+/*
+    Hands from a multi-pack shoe (CardCounts), where a card can be held more than once.
+
+    Two copies of 7H can go into two different melds, or one can be in a meld and the
+    other deadwood, so the one-pack shortcuts that treat a card as in or out don't
+    apply. A hand with no repeats is handed to the one-pack code, which costs one
+    test, so single-deck play doesn't pay for any of this.
+*/
+
+// layer k is the cards held more than k times; each layer's sets use their own copies
+inline MeldList find_sets(const CardCounts& hand) {
+    metrics::PhaseTimer timer(metrics::Phase::FindSets);
+    MeldList sets;
+    for (int k = 1; k <= max_decks; ++k) {
+        HandMask layer = hand.at_least(k);
+        if (!layer) {
+            break;
+        }
+        for (HandMask setRanks = set_ranks(layer); setRanks; setRanks &= setRanks - 1) {
+            sets.push_back(layer & ((setRanks & -setRanks) * lane_repeat));
+        }
+    }
+    return sets;
+}
+
+inline MeldList find_runs(const CardCounts& hand) {
+    metrics::PhaseTimer timer(metrics::Phase::FindRuns);
+    MeldList runs;
+    for (int k = 1; k <= max_decks; ++k) {
+        HandMask layer = hand.at_least(k);
+        if (!layer) {
+            break;
+        }
+        add_runs(layer, runs);
+    }
+    return runs;
+}
+
+// each meld covers one copy of each of its cards, if there is one left to cover
+inline int calculate_deadwood(const CardCounts& hand, const MeldList& sets, const MeldList& runs) {
+    metrics::PhaseTimer timer(metrics::Phase::CalculateDeadwood);
+    CardCounts rest = hand;
+    for (HandMask meld : sets) {
+        rest.remove(meld & rest.held());
+    }
+    for (HandMask meld : runs) {
+        rest.remove(meld & rest.held());
+    }
+    return deadwood_value(rest);
+}
+
+/*
+    MeldSolver over counts. Same search: the lowest card left is either one copy of
+    deadwood or part of a meld that still fits, cards no meld can reach are counted
+    straight away, and a small memo catches repeated sub-hands. The candidate melds
+    are the one-pack candidates of the distinct cards held, each usable as often as
+    there are copies for it.
+*/
+class ShoeMeldSolver
+{
+private:
+    static constexpr int memoSize = 64;
+
+    int candidateCount = 0;
+    HandMask candidates[max_meld_candidates];
+    CardCounts memoKey[memoSize];   // start out all zero
+    uint16 memoValue[memoSize];
+
+    static int memo_slot(const CardCounts& m) {
+        uint64 h = m.plane[0] ^ (m.plane[1] * 0xBF58476D1CE4E5B9ULL) ^
+                   (m.plane[2] * 0x94D049BB133111EBULL) ^ (m.plane[3] << 7);
+        return int((h * 0x9E3779B97F4A7C15ULL) >> 58);
+    }
+
+    // strip every copy of the cards no remaining meld can use, adding their value to dead
+    CardCounts reachable(CardCounts rem, int& dead) const {
+        HandMask held = rem.held();
+        HandMask meldable = 0;
+        for (int i = 0; i < candidateCount; ++i) {
+            if ((candidates[i] & held) == candidates[i]) {
+                meldable |= candidates[i];
+            }
+        }
+        CardCounts stranded = rem;
+        stranded.keep_only(~meldable);
+        dead += deadwood_value(stranded);
+        rem.keep_only(meldable);
+        return rem;
+    }
+
+    int solve(const CardCounts& hand) {
+        int dead = 0;
+        CardCounts rem = reachable(hand, dead);
+        HandMask held = rem.held();
+        if (held == 0) {
+            return dead;
+        }
+
+        // an empty hand never gets this far, so an all-zero key means an empty slot
+        int slot = memo_slot(rem);
+        if (memoKey[slot] == rem) {
+            return dead + memoValue[slot];
+        }
+
+        HandMask low = held & -held;
+        int lowValue = deadwood_value(low);
+        int best = deadwood_value(rem);
+
+        for (int i = 0; i < candidateCount && best > 0; ++i) {
+            HandMask meld = candidates[i];
+            if ((meld & low) && (meld & held) == meld) {
+                CardCounts next = rem;
+                next.remove(meld);
+                int value = solve(next);
+                if (value < best) {
+                    best = value;
+                }
+            }
+        }
+
+        if (lowValue < best) {
+            CardCounts next = rem;
+            next.remove(low);
+            int value = lowValue + solve(next);
+            if (value < best) {
+                best = value;
+            }
+        }
+
+        memoKey[slot] = rem;
+        memoValue[slot] = uint16(best);
+        return dead + best;
+    }
+
+public:
+    explicit ShoeMeldSolver(const CardCounts& hand) {
+        candidateCount = list_meld_candidates(hand.held(), candidates);
+    }
+
+    int min_deadwood(const CardCounts& hand) {
+        if (candidateCount == 0) {
+            return deadwood_value(hand);
+        }
+        return solve(hand);
+    }
+};
+
+inline int min_deadwood(const CardCounts& hand) {
+    if (!hand.repeated()) {
+        return min_deadwood(hand.plane[0]);
+    }
+    metrics::PhaseTimer timer(metrics::Phase::MinDeadwood);
+    ShoeMeldSolver solver(hand);
+    return solver.min_deadwood(hand);
+}
+
+// best_discard for a hand with repeats: throwing either copy of a card is the same
+inline Card best_discard(const CardCounts& hand, int& deadwoodAfter) {
+    if (!hand.repeated()) {
+        return best_discard(hand.plane[0], deadwoodAfter);
+    }
+    Card best = {0, 0};
+    deadwoodAfter = -1;
+    for (HandMask rest = hand.held(); rest; rest &= rest - 1) {
+        CardCounts after = hand;
+        after.remove(rest & -rest);
+        int deadwood = min_deadwood(after);
+        Card c = bit_card(__builtin_ctzll(rest));
+        if (deadwoodAfter < 0 || deadwood < deadwoodAfter ||
+            (deadwood == deadwoodAfter && card_value(c) > card_value(best))) {
+            best = c;
+            deadwoodAfter = deadwood;
+        }
+    }
+    return best;
+}
+
+// evaluate_discards for a hand with repeats: one choice per distinct card, potential from the cards held
+inline int evaluate_discards(const CardCounts& hand, DiscardChoice* out,
+                             DeadwoodLookup* lookup = nullptr) {
+    if (!hand.repeated()) {
+        return evaluate_discards(hand.plane[0], out, lookup);
+    }
+    int count = 0;
+    for (HandMask rest = hand.held(); rest; rest &= rest - 1) {
+        CardCounts after = hand;
+        after.remove(rest & -rest);
+        out[count].card = bit_card(__builtin_ctzll(rest));
+        out[count].deadwood = min_deadwood(after);
+        out[count].potential = meld_potential(after.held());
+        ++count;
+    }
+    return count;
+}
+
+// reference for the shoe solver: every candidate meld, used 0, 1, 2... times
+inline int min_deadwood_reference(const HandMask* candidates, int count, int index,
+                                  CardCounts rem) {
+    if (index == count) {
+        return deadwood_value(rem);
+    }
+    int best = min_deadwood_reference(candidates, count, index + 1, rem);
+    if ((candidates[index] & rem.held()) == candidates[index]) {
+        rem.remove(candidates[index]);
+        int value = min_deadwood_reference(candidates, count, index, rem);
+        if (value < best) {
+            best = value;
+        }
+    }
+    return best;
+}
+
+inline int min_deadwood_reference(const CardCounts& hand) {
+    std::vector<HandMask> candidates(max_meld_candidates);
+    int count = list_meld_candidates(hand.held(), candidates.data());
+    return min_deadwood_reference(candidates.data(), count, 0, hand);
+}
+
+// split an arrangement into its sets and runs, for display_melds and score_round
+inline void split_melds(const MeldPartition& partition, MeldList& sets, MeldList& runs) {
+    sets = MeldList();
+    runs = MeldList();
+    for (int i = 0; i < partition.meldCount; ++i) {
+        if (meld_is_run(partition.melds[i])) {
+            runs.push_back(partition.melds[i]);
+        } else {
+            sets.push_back(partition.melds[i]);
+        }
+    }
+}
+
+/*
+    Layoffs: after a knock (not gin) the defender may add deadwood to the knocker's
+    melds, the fourth card of a 3-card set or cards that extend a run at either end
+    (one after another, so 8 then 9 onto 5-6-7). The defender picks which cards to
+    lay off and how to meld the rest to leave the least deadwood.
+
+    Runs grow only from the knocker's run cards, so which cards can go is a flood
+    fill of shifts from those runs through the defender's hand, plus the missing
+    card of each set. A card that could go but sits in none of the defender's own
+    candidate melds is always laid off, since it is deadwood otherwise. Only the
+    cards that could also meld at home are a real choice, and each subset of those
+    is tried with the solver on what is left. That is usually zero or one card, so
+    a knock costs about one extra min_deadwood.
+*/
+struct LayoffResult {
+    int deadwood;       // the defender's deadwood after laying off
+    HandMask laidOff;
+};
+
+// the cards of allowed that can be laid off on runs / sets (together, as chains allow)
+inline HandMask layable_cards(HandMask runs, HandMask setFourths, HandMask allowed) {
+    HandMask extended = runs;
+    while (true) {
+        HandMask next = ((extended << 1) | (extended >> 1)) & all_cards & allowed & ~extended;
+        if (!next) {
+            break;
+        }
+        extended |= next;
+    }
+    return (extended & ~runs) | (setFourths & allowed);
+}
+
+// layoffs onto an arrangement of the knocker's melds, every mask laid out in Ranks' order
+template <class Ranks>
+inline LayoffResult resolve_layoffs(const HandMask* melds, int meldCount, HandMask defender) {
+    HandMask runs = 0;
+    HandMask setFourths = 0;
+    for (int i = 0; i < meldCount; ++i) {
+        if (meld_is_run(melds[i])) {
+            runs |= melds[i];
+        } else if (card_count(melds[i]) == 3) {
+            HandMask column = (HandMask(1) << (__builtin_ctzll(melds[i]) % lanewidth)) * lane_repeat;
+            setFourths |= column & ~melds[i];
+        }
+    }
+
+    LayoffResult best = {min_deadwood<Ranks>(defender), 0};
+    HandMask reach = layable_cards(runs, setFourths, defender);
+    if (!reach) {
+        return best;
+    }
+    HandMask choices = reach & (set_cards(defender) | run_cards(defender));
+    HandMask always = reach & ~choices;
+
+    // every subset of choices, including none of them
+    HandMask subset = 0;
+    do {
+        HandMask laid = layable_cards(runs, setFourths, always | subset);
+        int deadwood = min_deadwood<Ranks>(defender & ~laid);
+        if (deadwood < best.deadwood) {
+            best = {deadwood, laid};
+        }
+        subset = (subset - choices) & choices;
+    } while (subset);
+    return best;
+}
+
+inline LayoffResult resolve_layoffs(const HandMask* melds, int meldCount, HandMask defender) {
+    return resolve_layoffs<AceLowRanks>(melds, meldCount, defender);
+}
+
+inline LayoffResult resolve_layoffs(const MeldList& sets, const MeldList& runs, HandMask defender) {
+    HandMask melds[max_melds * 2];
+    int count = 0;
+    for (HandMask m : sets) {
+        melds[count++] = m;
+    }
+    for (HandMask m : runs) {
+        melds[count++] = m;
+    }
+    return resolve_layoffs(melds, count, defender);
+}
+
+// layoffs onto the knocker's least-deadwood arrangement, the one IncrementalHand::best_melds shows
+template <class Ranks>
+inline LayoffResult resolve_layoffs(HandMask knocker, HandMask defender) {
+    MeldPartition partition =
+        solve_melds<Ranks>(knocker & (set_cards(knocker) | run_cards(knocker)));
+    return resolve_layoffs<Ranks>(partition.melds, partition.meldCount, defender);
+}
+
+inline LayoffResult resolve_layoffs(HandMask knocker, HandMask defender) {
+    return resolve_layoffs<AceLowRanks>(knocker, defender);
+}
+
+/*
+    Reference for resolve_layoffs: lay off one card at a time in every order onto
+    every meld it fits, and score what is left with min_deadwood_reference.
+    Exponential, only for checking.
+*/
+inline int layoff_deadwood_reference(HandMask* melds, int meldCount, HandMask defender) {
+    int best = min_deadwood_reference(defender);
+    for (HandMask rest = defender; rest; rest &= rest - 1) {
+        HandMask card = rest & -rest;
+        for (int i = 0; i < meldCount; ++i) {
+            HandMask meld = melds[i];
+            bool fits;
+            if (meld_is_run(meld)) {
+                HandMask low = meld & -meld;
+                HandMask high = HandMask(1) << (63 - __builtin_clzll(meld));
+                fits = (card == low >> 1 || card == high << 1) &&
+                       meld_is_run(meld | card);
+            } else {
+                fits = card_count(meld) == 3 &&
+                       __builtin_ctzll(card) % lanewidth == __builtin_ctzll(meld) % lanewidth;
+            }
+            if (fits) {
+                melds[i] = meld | card;
+                int value = layoff_deadwood_reference(melds, meldCount, defender & ~card);
+                melds[i] = meld;
+                if (value < best) {
+                    best = value;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+inline int layoff_deadwood_reference(HandMask knocker, HandMask defender) {
+    MeldPartition partition = solve_melds(knocker);
+    return layoff_deadwood_reference(partition.melds, partition.meldCount, defender);
+}
+
+/*
+    A hand that keeps its meld candidates and deadwood up to date as cards come and go.
+
+    Adding or removing a card can only change the runs in that card's suit and the set
+    for that card's rank, so only that lane and that rank column are recomputed. The
+    exact solver only ever sees the cards that are in some candidate meld, and its
+    answer is kept until that subset changes, so drawing or throwing a card that can't
+    meld costs a few bit operations however big the hand is.
+*/
+class IncrementalHand
+{
+private:
+    CardPile hand;              // in the order the player sees it
+    HandMask mask = 0;
+    HandMask runMask = 0;       // cards inside some run of 3+
+    HandMask setMask = 0;       // cards inside some set
+    int handValue = 0;          // deadwood value of every card held
+
+    HandMask solvedFor = ~HandMask(0);
+    MeldPartition solved;
+
+    void update(Card c) {
+        HandMask lane = lane_ranks << ((c.suit - 1) * lanewidth);
+        HandMask column = (HandMask(1) << (c.rank - 1)) * lane_repeat;
+        runMask = (runMask & ~lane) | run_cards(mask & lane);
+        setMask = (setMask & ~column) | set_cards(mask & column);
+    }
+
+    const MeldPartition& solve() {
+        HandMask meldable = runMask | setMask;
+        if (meldable != solvedFor) {
+            solved = solve_melds(meldable);
+            solvedFor = meldable;
+        }
+        return solved;
+    }
+
+public:
+    IncrementalHand() {}
+
+    // deals n cards off the deck (none if it hasn't got that many)
+    IncrementalHand(Deck& deck, uint8 n) {
+        CardPile dealt;
+        deck.deal_hand(dealt, n);
+        for (const Card& c : dealt) {
+            add(c);
+        }
+    }
+
+    void add(Card c) {
+        hand.push_back(c);
+        mask |= card_bit(c);
+        handValue += card_value(c);
+        update(c);
+    }
+
+    // takes the card at a display position (0-based) out of the hand
+    Card remove_at(size_t index) {
+        Card c = hand[index];
+        hand.erase(index);
+        mask &= ~card_bit(c);
+        handValue -= card_value(c);
+        update(c);
+        return c;
+    }
+
+    const CardPile& cards() const { return hand; }
+    size_t size() const { return hand.size(); }
+    HandMask bits() const { return mask; }
+
+    // same lists find_sets and find_runs give for this hand
+    MeldList sets() const {
+        return find_sets(setMask);
+    }
+    MeldList runs() const {
+        return find_runs(runMask);
+    }
+
+    // least deadwood over every non-overlapping arrangement
+    int deadwood() {
+        HandMask meldable = runMask | setMask;
+        return handValue - deadwood_value(meldable) + solve().deadwood;
+    }
+
+    // the arrangement behind deadwood(), split for display_melds and score_round
+    void best_melds(MeldList& sets, MeldList& runs) {
+        split_melds(solve(), sets, runs);
+    }
+};
+
+#endif /* card_utils_h */
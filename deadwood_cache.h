@@ -0,0 +1,219 @@
+#ifndef deadwood_cache_h
+#define deadwood_cache_h
+
+#include "deck.h"
+#include "card_utils.h"
+#include <atomic>
+#include <memory>
+
+/*
+    Melds and deadwood only depend on the rank pattern of each suit, not on which
+    suit holds which pattern, so the 24 ways of relabelling the suits of a hand all
+    score the same. canonical_hand() picks one of them to stand for the rest, and
+    DeadwoodCache keeps solved hands under that form, so a hand seen before in any
+    suits is answered without running the solver.
+
+    Only hands whose melds overlap go through the cache. Every other hand is scored
+    by melds_without_overlap in a few bit operations, which is quicker than finding
+    the hand in the table; for the overlapping ones a hit is about 4x quicker than
+    the solver.
+*/
+
+/*
+    The suit relabelling of a hand with the smallest mask: the four lanes sorted so
+    the biggest pattern sits in the lowest lane. suitOf[i] says which suit (0-3) of
+    the original hand ended up in lane i, so results can be mapped back.
+*/
+struct CanonicalHand {
+    HandMask mask;
+    uint8 suitOf[suitcount];
+};
+
+inline CanonicalHand canonical_hand(HandMask hand) {
+    uint16 lane[suitcount];
+    uint8 suit[suitcount];
+    for (int i = 0; i < suitcount; ++i) {
+        lane[i] = uint16(hand >> (i * lanewidth));
+        suit[i] = uint8(i);
+    }
+    // 5-comparator sorting network, biggest lane first
+    auto order = [&](int a, int b) {
+        if (lane[a] < lane[b]) {
+            std::swap(lane[a], lane[b]);
+            std::swap(suit[a], suit[b]);
+        }
+    };
+    order(0, 1);
+    order(2, 3);
+    order(0, 2);
+    order(1, 3);
+    order(1, 2);
+
+    CanonicalHand canonical;
+    canonical.mask = 0;
+    for (int i = 0; i < suitcount; ++i) {
+        canonical.mask |= HandMask(lane[i]) << (i * lanewidth);
+        canonical.suitOf[i] = suit[i];
+    }
+    return canonical;
+}
+
+// a mask in canonical lanes put back into the hand's own suits
+inline HandMask uncanonical(HandMask m, const CanonicalHand& canonical) {
+    HandMask out = 0;
+    for (int i = 0; i < suitcount; ++i) {
+        out |= ((m >> (i * lanewidth)) & lane_ranks) << (canonical.suitOf[i] * lanewidth);
+    }
+    return out;
+}
+
+struct DeadwoodCacheStats {
+    uint64 hits = 0;
+    uint64 misses = 0;
+
+    double hit_rate() const {
+        return hits + misses ? double(hits) / double(hits + misses) : 0;
+    }
+};
+
+/*
+    A fixed-size table from canonical hand to its least deadwood and the cards that
+    melds cover in that arrangement, shared by any number of threads with no lock.
+
+    Like EndgameTable an entry is two words, the packed result and the key xored
+    with it, so a torn read fails the check and counts as a miss. The key is the
+    canonical mask itself, so a hit is never a different hand. A new result always
+    replaces the old one, which keeps the table's size fixed whatever it is fed.
+
+    Hits and misses (of the overlapping hands, the only ones looked up) are counted
+    per thread slot, each on its own cache line, so counting doesn't make the
+    threads fight over one word.
+*/
+class DeadwoodCache : public DeadwoodLookup
+{
+private:
+    static constexpr int counterSlots = 16;
+
+    struct Entry {
+        std::atomic<uint64> check;
+        std::atomic<uint64> data;
+    };
+
+    struct alignas(64) Counters {
+        std::atomic<uint64> hits{0};
+        std::atomic<uint64> misses{0};
+    };
+
+    std::unique_ptr<Entry[]> entries;
+    uint64 mask;
+    int shift;
+    Counters counters[counterSlots];
+
+    // the 13 rank bits of each lane side by side in 52 bits, then a bit that says
+    // whether they are filled in (a min_deadwood miss doesn't work them out), then
+    // the deadwood in the top 11
+    static constexpr int knownBit = suitcount * rankcount;
+    static constexpr int deadwoodShift = knownBit + 1;
+
+    static uint64 pack(HandMask melded, bool known, int deadwood) {
+        uint64 data = 0;
+        for (int i = 0; i < suitcount; ++i) {
+            data |= ((melded >> (i * lanewidth)) & lane_ranks) << (i * rankcount);
+        }
+        return data | (uint64(known) << knownBit) | (uint64(deadwood) << deadwoodShift);
+    }
+
+    static HandMask unpack_melded(uint64 data) {
+        HandMask melded = 0;
+        for (int i = 0; i < suitcount; ++i) {
+            melded |= ((data >> (i * rankcount)) & lane_ranks) << (i * lanewidth);
+        }
+        return melded;
+    }
+
+    static Counters& slot_counters(Counters* all) {
+        static std::atomic<unsigned> nextSlot{0};
+        thread_local unsigned slot = nextSlot++ % counterSlots;
+        return all[slot];
+    }
+
+    /*
+        canonical hand -> packed result, solving and storing it on a miss. Only
+        withMelds solves for the arrangement as well as its deadwood; a hit that
+        lacks it counts as a miss.
+    */
+    uint64 lookup(HandMask canonical, bool withMelds) {
+        Entry& e = entries[(canonical * 0x9E3779B97F4A7C15ULL) >> shift];
+        Counters& c = slot_counters(counters);
+        uint64 data = e.data.load(std::memory_order_relaxed);
+        uint64 check = e.check.load(std::memory_order_relaxed);
+        if ((check ^ data) == canonical && (!withMelds || ((data >> knownBit) & 1))) {
+            c.hits.fetch_add(1, std::memory_order_relaxed);
+            return data;
+        }
+        c.misses.fetch_add(1, std::memory_order_relaxed);
+        if (withMelds) {
+            MeldPartition best = solve_melds(canonical);
+            data = pack(best.melded, true, best.deadwood);
+        } else {
+            MeldSolver solver(canonical);
+            data = pack(0, false, solver.min_deadwood(canonical));
+        }
+        e.check.store(canonical ^ data, std::memory_order_relaxed);
+        e.data.store(data, std::memory_order_relaxed);
+        return data;
+    }
+
+public:
+    // 2^log2Entries entries of 16 bytes, 4 MB by default
+    explicit DeadwoodCache(int log2Entries = 18)
+        : entries(new Entry[size_t(1) << log2Entries]),
+          mask((uint64(1) << log2Entries) - 1), shift(64 - log2Entries) {
+        clear();
+    }
+
+    void clear() {
+        // the empty hand has 0 deadwood and nothing melded, so a zeroed entry is right for it
+        for (uint64 i = 0; i <= mask; ++i) {
+            entries[i].check.store(0, std::memory_order_relaxed);
+            entries[i].data.store(0, std::memory_order_relaxed);
+        }
+        for (Counters& c : counters) {
+            c.hits.store(0, std::memory_order_relaxed);
+            c.misses.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // same answer as ::min_deadwood(hand)
+    int min_deadwood(HandMask hand) override {
+        HandMask melded;
+        if (melds_without_overlap(hand, melded)) {
+            return deadwood_value(hand & ~melded);
+        }
+        return int(lookup(canonical_hand(hand).mask, false) >> deadwoodShift);
+    }
+
+    // the cards melds cover in a least-deadwood arrangement of hand
+    HandMask melded(HandMask hand, int& deadwood) {
+        HandMask covered;
+        if (melds_without_overlap(hand, covered)) {
+            deadwood = deadwood_value(hand & ~covered);
+            return covered;
+        }
+        CanonicalHand canonical = canonical_hand(hand);
+        uint64 data = lookup(canonical.mask, true);
+        deadwood = int(data >> deadwoodShift);
+        return uncanonical(unpack_melded(data), canonical);
+    }
+
+    DeadwoodCacheStats stats() const {
+        DeadwoodCacheStats total;
+        for (const Counters& c : counters) {
+            total.hits += c.hits.load(std::memory_order_relaxed);
+            total.misses += c.misses.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+#endif /* deadwood_cache_h */
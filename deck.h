@@ -4,9 +4,13 @@
 //Add all your included libraries below this line
 #include <cstdint>
 #include <cstdlib>
+#include <ctime>
+#include <iterator>
 #include <iostream>
+#include <random>
 #include <vector>
 #include <string>
+#include <utility>
 using std::cout;
 
 // use typedef to define differnt types of integers
@@ -22,7 +26,7 @@ const std::string suitstr = "_CDHS"; //Clubs, Diamond, Heart and Spade. Const as
 // first char is underscore as we refer to this suitstr and access it by index. We have no 0 rank.
 const std::string facecards = "ATJQK"; //Ace, Ten, Jack, Queen, King. Const as will never change.
 constexpr uint8 default_deck = 52; // Every deck of cards must include 52 cards
-constexpr uint8 max_decks = 1; // on start, the programmer can initiate a maximum of 1 pack in a deck
+constexpr uint8 max_decks = 10; // on start, the programmer can initiate a maximum of 10 packs in a deck
 constexpr uint8 suitcount = 4; //There are 4 possible suit
 constexpr uint8 rankcount = 13; // there are 13 different ranking in a deck 2 to 10 +jack, Queen, king and Ace
 
@@ -35,6 +39,447 @@ typedef struct {
 } Card;
 
 
+/*
+    A list of cards with its storage inline, for hands and piles. No round ever holds
+    more cards than the shoe, so a list never touches the heap and resetting one for
+    the next round is just setting its size back to zero.
+    Adding past Capacity is not checked, size the list for the worst case.
+*/
+template <int Capacity>
+class CardList
+{
+private:
+    uint16 count = 0;
+    Card cards[Capacity];
+
+public:
+    uint16 size() const { return count; }
+    bool empty() const { return count == 0; }
+    void clear() { count = 0; }
+
+    void push_back(Card c) { cards[count++] = c; }
+    void pop_back() { --count; }
+    const Card& back() const { return cards[count - 1]; }
+
+    const Card& operator[](size_t index) const { return cards[index]; }
+    const Card* begin() const { return cards; }
+    const Card* end() const { return cards + count; }
+
+    // keeps the order of the cards after it
+    void erase(size_t index) {
+        for (size_t i = index; i + 1 < count; ++i) {
+            cards[i] = cards[i + 1];
+        }
+        --count;
+    }
+};
+
+// big enough for every card in the shoe: a hand, the discard pile, a dealt stack
+typedef CardList<default_deck * max_decks> CardPile;
+
+// splitmix64 step: turns any 64-bit value (a counter, a match number) into a
+// well-mixed seed, so neighbouring seeds don't give similar games
+inline uint64 mix_seed(uint64 x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// A hand as a bitboard: one 16-bit lane per suit, rank r lives at bit (r-1) of its lane.
+// Bits 13-15 of each lane are always zero, so shifting a whole mask never lets a
+// run leak from one suit into the next.
+typedef uint64 HandMask;
+
+constexpr uint8 lanewidth = 16; // bits reserved per suit inside a HandMask
+constexpr HandMask lane_ranks = 0x1FFF; // the 13 rank bits of a single lane
+constexpr HandMask lane_repeat = 0x0001000100010001ULL; // multiply a lane pattern into all 4 suits
+constexpr HandMask all_cards = lane_ranks * lane_repeat;
+
+// Deadwood is Ace=1, 2-9 face value, 10/J/Q/K=10. Each plane holds the ranks whose
+// value has that bit set, so the deadwood of a mask is a weighted sum of 4 popcounts.
+constexpr HandMask value_bit0 = 0x0155 * lane_repeat; // A,3,5,7,9
+constexpr HandMask value_bit1 = 0x1E66 * lane_repeat; // 2,3,6,7,T,J,Q,K
+constexpr HandMask value_bit2 = 0x0078 * lane_repeat; // 4,5,6,7
+constexpr HandMask value_bit3 = 0x1F80 * lane_repeat; // 8,9,T,J,Q,K
+
+inline int card_count(HandMask m) {
+    return __builtin_popcountll(m);
+}
+
+inline HandMask card_bit(Card c) {
+    return HandMask(1) << ((c.suit - 1) * lanewidth + (c.rank - 1));
+}
+
+// inverse of card_bit, takes the bit index (0-63) of a set bit
+inline Card bit_card(int bit) {
+    Card c = {uint8(bit / lanewidth + 1), uint8(bit % lanewidth + 1)};
+    return c;
+}
+
+// the 13-bit rank pattern of one suit (1-4)
+inline HandMask suit_lane(HandMask m, uint8 suit) {
+    return (m >> ((suit - 1) * lanewidth)) & lane_ranks;
+}
+
+inline HandMask to_mask(const std::vector<Card>& cards) {
+    HandMask m = 0;
+    for (const Card& c : cards) {
+        m |= card_bit(c);
+    }
+    return m;
+}
+
+template <int Capacity>
+inline HandMask to_mask(const CardList<Capacity>& cards) {
+    HandMask m = 0;
+    for (const Card& c : cards) {
+        m |= card_bit(c);
+    }
+    return m;
+}
+
+// cards come out sorted by suit, then rank
+inline std::vector<Card> to_cards(HandMask m) {
+    std::vector<Card> cards;
+    cards.reserve(card_count(m));
+    while (m) {
+        cards.push_back(bit_card(__builtin_ctzll(m)));
+        m &= m - 1;
+    }
+    return cards;
+}
+
+inline int card_value(Card c) {
+    return c.rank >= 10 ? 10 : c.rank;
+}
+
+inline int deadwood_value(HandMask m) {
+    return card_count(m & value_bit0)
+         + 2 * card_count(m & value_bit1)
+         + 4 * card_count(m & value_bit2)
+         + 8 * card_count(m & value_bit3);
+}
+
+// 13-bit mask of the ranks held in at least 3 different suits
+inline HandMask set_ranks(HandMask m) {
+    HandMask a = m & lane_ranks;
+    HandMask b = (m >> lanewidth) & lane_ranks;
+    HandMask c = (m >> (2 * lanewidth)) & lane_ranks;
+    HandMask d = (m >> (3 * lanewidth)) & lane_ranks;
+    // "at least 3 of 4" is the 4-input majority
+    return (a & b & (c | d)) | (c & d & (a | b));
+}
+
+// every card that belongs to some set
+inline HandMask set_cards(HandMask m) {
+    return m & (set_ranks(m) * lane_repeat);
+}
+
+// every card that belongs to some run of 3+ in the same suit
+inline HandMask run_cards(HandMask m) {
+    // a bit survives if it starts a run of at least 3
+    HandMask starts = m & (m >> 1) & (m >> 2);
+    return starts | (starts << 1) | (starts << 2);
+}
+
+/*
+    Rank orders, for the rule variants in gin_rummy.h. Runs are found by shifting a
+    lane, so a rule that changes which ranks are neighbours is just another order of
+    the bits in each lane: layout() moves a card_bit mask into it, cards() moves it
+    back, and deadwood() counts a mask in that order. Sets, the meld tables and the
+    solvers in card_utils.h work on any order unchanged.
+*/
+
+// A-2-3 is a run and Q-K-A isn't: card_bit order as it is
+struct AceLowRanks {
+    static constexpr bool shoes = true;     // also good for CardCounts planes
+    static HandMask layout(HandMask m) { return m; }
+    static HandMask cards(HandMask m) { return m; }
+    static int deadwood(HandMask m) { return deadwood_value(m); }
+};
+
+// Q-K-A is a run and A-2-3 isn't: 2..K move down to bits 0-11 and the ace up to bit 12,
+// still worth 1. One pack only.
+struct AceHighRanks {
+    static constexpr bool shoes = false;
+    static constexpr HandMask aces = lane_repeat;
+    static constexpr HandMask notAces = 0x0FFF * lane_repeat;
+
+    // value_bit0-3 in this order
+    static constexpr HandMask value0 = 0x10AA * lane_repeat; // 3,5,7,9,A
+    static constexpr HandMask value1 = 0x0F33 * lane_repeat; // 2,3,6,7,T,J,Q,K
+    static constexpr HandMask value2 = 0x003C * lane_repeat; // 4,5,6,7
+    static constexpr HandMask value3 = 0x0FC0 * lane_repeat; // 8,9,T,J,Q,K
+
+    static HandMask layout(HandMask m) { return ((m >> 1) & notAces) | ((m & aces) << 12); }
+    static HandMask cards(HandMask m) { return ((m & notAces) << 1) | ((m >> 12) & aces); }
+    static int deadwood(HandMask m) {
+        return card_count(m & value0) + 2 * card_count(m & value1) +
+               4 * card_count(m & value2) + 8 * card_count(m & value3);
+    }
+};
+
+
+/*
+    A hand dealt from a shoe of several packs, where the same card can be held more
+    than once. Each card's count is a 4-bit number stored bit-sliced: plane[i] is a
+    HandMask of the cards whose count has bit i set, so count = sum of plane bits << i.
+    Adding or taking away a whole meld is then a carry or borrow rippled through 4 words,
+    and anything written for a HandMask (lanes, the meld tables, the deadwood planes)
+    works on a plane. A one-pack hand is just plane[0].
+*/
+constexpr int count_planes = 4;
+static_assert(max_decks < (1 << count_planes), "a card's count has to fit in 4 bits");
+
+struct CardCounts {
+    HandMask plane[count_planes] = {0, 0, 0, 0};
+
+    CardCounts() {}
+    explicit CardCounts(HandMask single) {
+        plane[0] = single;
+    }
+
+    // every card held at least once
+    HandMask held() const {
+        return plane[0] | plane[1] | plane[2] | plane[3];
+    }
+
+    // cards held more than once
+    HandMask repeated() const {
+        return plane[1] | plane[2] | plane[3];
+    }
+
+    bool empty() const {
+        return held() == 0;
+    }
+
+    int count(HandMask bit) const {
+        return int(!!(plane[0] & bit)) | int(!!(plane[1] & bit)) << 1 |
+               int(!!(plane[2] & bit)) << 2 | int(!!(plane[3] & bit)) << 3;
+    }
+
+    // cards held at least n times: a bit-sliced compare against the constant n
+    HandMask at_least(int n) const {
+        HandMask greater = 0;
+        HandMask equal = ~HandMask(0);
+        for (int i = count_planes - 1; i >= 0; --i) {
+            if ((n >> i) & 1) {
+                equal &= plane[i];
+            } else {
+                greater |= equal & plane[i];
+                equal &= ~plane[i];
+            }
+        }
+        return greater | equal;
+    }
+
+    // one more copy of every card in cards
+    void add(HandMask cards) {
+        HandMask carry = cards;
+        for (int i = 0; i < count_planes; ++i) {
+            HandMask next = plane[i] & carry;
+            plane[i] ^= carry;
+            carry = next;
+        }
+    }
+
+    // one copy fewer of every card in cards, each of which must be held
+    void remove(HandMask cards) {
+        HandMask borrow = cards;
+        for (int i = 0; i < count_planes; ++i) {
+            HandMask next = ~plane[i] & borrow;
+            plane[i] ^= borrow;
+            borrow = next;
+        }
+    }
+
+    // drop every copy of the cards outside keep
+    void keep_only(HandMask keep) {
+        for (int i = 0; i < count_planes; ++i) {
+            plane[i] &= keep;
+        }
+    }
+
+    bool operator==(const CardCounts& o) const {
+        return plane[0] == o.plane[0] && plane[1] == o.plane[1] &&
+               plane[2] == o.plane[2] && plane[3] == o.plane[3];
+    }
+};
+
+inline int card_count(const CardCounts& h) {
+    return card_count(h.plane[0]) + 2 * card_count(h.plane[1]) +
+           4 * card_count(h.plane[2]) + 8 * card_count(h.plane[3]);
+}
+
+inline int deadwood_value(const CardCounts& h) {
+    return deadwood_value(h.plane[0]) + 2 * deadwood_value(h.plane[1]) +
+           4 * deadwood_value(h.plane[2]) + 8 * deadwood_value(h.plane[3]);
+}
+
+/*
+    Meld tables, built by the compiler.
+
+    One suit only has 2^13 rank patterns and one rank only has 2^4 suit patterns,
+    so the runs of every suit pattern and the sets of every rank pattern are worked
+    out at compile time. Listing melds is then a lookup with no sorting or scanning,
+    and the tables are plain constant data in the binary (no startup cost).
+*/
+struct SuitRuns {
+    uint16 cover;   // rank bits inside some run of 3+
+    uint8 count;    // maximal runs, at most 3 fit in 13 ranks
+    uint8 run[3];   // each maximal run: first rank bit in the low nibble, length in the high
+
+    constexpr int start(int i) const { return run[i] & 0xF; }
+    constexpr int length(int i) const { return run[i] >> 4; }
+};
+
+struct SuitRunTable {
+    SuitRuns pattern[1 << rankcount];
+};
+
+constexpr SuitRunTable build_suit_runs() {
+    SuitRunTable table{};
+    for (int lane = 0; lane < (1 << rankcount); ++lane) {
+        SuitRuns& entry = table.pattern[lane];
+        int bit = 0;
+        while (bit < rankcount) {
+            int length = 0;
+            while (bit + length < rankcount && (lane >> (bit + length)) & 1) {
+                ++length;
+            }
+            if (length >= 3) {
+                entry.cover |= uint16(((1 << length) - 1) << bit);
+                entry.run[entry.count++] = uint8(bit | (length << 4));
+            }
+            bit += length + 1;
+        }
+    }
+    return table;
+}
+
+constexpr SuitRunTable suit_runs = build_suit_runs();
+static_assert(suit_runs.pattern[0x1F77].count == 3 && suit_runs.pattern[0x1F77].cover == 0x1F77,
+              "A-2-3, 5-6-7 and 9-T-J-Q-K are three separate runs");
+
+struct RankSets {
+    uint8 count;        // set candidates: 1 for 3 suits, 5 for 4 (the 4-set and each 3-card subset)
+    HandMask sets[5];   // each candidate on the Ace column, shift left by rank-1 to place it
+};
+
+struct RankSetTable {
+    RankSets pattern[1 << suitcount];
+};
+
+// spread a 4-bit suit pattern onto the Ace column of a HandMask
+constexpr HandMask spread_suits(int suits) {
+    HandMask m = 0;
+    for (int suit = 0; suit < suitcount; ++suit) {
+        if ((suits >> suit) & 1) {
+            m |= HandMask(1) << (suit * lanewidth);
+        }
+    }
+    return m;
+}
+
+constexpr RankSetTable build_rank_sets() {
+    RankSetTable table{};
+    for (int suits = 0; suits < (1 << suitcount); ++suits) {
+        RankSets& entry = table.pattern[suits];
+        int held = (suits & 1) + ((suits >> 1) & 1) + ((suits >> 2) & 1) + ((suits >> 3) & 1);
+        if (held >= 3) {
+            entry.sets[entry.count++] = spread_suits(suits);
+        }
+        if (held == 4) {
+            for (int suit = 0; suit < suitcount; ++suit) {
+                entry.sets[entry.count++] = spread_suits(suits & ~(1 << suit));
+            }
+        }
+    }
+    return table;
+}
+
+constexpr RankSetTable rank_sets = build_rank_sets();
+static_assert(rank_sets.pattern[0xF].count == 5 && rank_sets.pattern[0x3].count == 0,
+              "4 suits give the 4-set plus four 3-sets, 2 suits give nothing");
+
+// the 4-bit suit pattern of one rank bit (0-12)
+inline int rank_column(HandMask m, int rankBit) {
+    HandMask column = (m >> rankBit) & lane_repeat;
+    // fold the 4 lane bits (0, 16, 32, 48) down into bits 0-3
+    return int((column | (column >> 15) | (column >> 30) | (column >> 45)) & 0xF);
+}
+
+/*
+    xoshiro256** generator: 4 words of state, a handful of shifts/rotates per number,
+    and far faster than std::mt19937_64. Seeding runs the seed through mix_seed so
+    even seeds 0, 1, 2... start from unrelated states.
+    Has the UniformRandomBitGenerator members, so it also works with <random>/<algorithm>.
+*/
+class Rng
+{
+private:
+    uint64 state[4];
+
+    static uint64 rotl(uint64 x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+public:
+    typedef uint64 result_type;
+
+    explicit Rng(uint64 seed = 0) {
+        reseed(seed);
+    }
+
+    void reseed(uint64 seed) {
+        for (int i = 0; i < 4; ++i) {
+            seed = mix_seed(seed);
+            state[i] = seed;
+        }
+    }
+
+    uint64 next() {
+        uint64 result = rotl(state[1] * 5, 7) * 9;
+        uint64 t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    /*
+        Unbiased number in [0, n). rand() % n favours small numbers whenever n doesn't
+        divide RAND_MAX+1; this is Lemire's multiply-shift, which only has to retry in
+        the rare case the low half lands in the biased zone.
+    */
+    uint32 below(uint32 n) {
+        uint64 product = uint64(uint32(next() >> 32)) * n;
+        uint32 low = uint32(product);
+        if (low < n) {
+            uint32 threshold = uint32(-n) % n;
+            while (low < threshold) {
+                product = uint64(uint32(next() >> 32)) * n;
+                low = uint32(product);
+            }
+        }
+        return uint32(product >> 32);
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~result_type(0); }
+    result_type operator()() { return next(); }
+};
+
+// a seed that differs between runs and between decks made in the same second
+inline uint64 fresh_seed() {
+    std::random_device device;
+    return mix_seed((uint64(device()) << 32) ^ device() ^ uint64(time(nullptr)));
+}
+
 // add content to class Deck. the word DATATYPE is just a filler. 
 // Change for any datatype that suits you based on the 
 class Deck
@@ -44,38 +489,49 @@ private:
     uint8 cardsPerDeck = 0;
     uint8 numDecks = 0;
     uint16 remainingCardCount = 0;
-    std::vector<Card> deck;
+    // fixed storage for the biggest shoe, dealing just moves remainingCardCount down
+    // so a Deck never allocates after construction
+    Card deck[default_deck * max_decks];
+    // every Deck owns its generator, so decks on different threads never share state
+    Rng rng;
 
 public:
     //used unsigned casting as otherwise it'll assign the ascii value of 52, which is four
-    Deck() : cardsPerDeck((unsigned) default_deck), numDecks(1)
+    Deck() : cardsPerDeck((unsigned) default_deck), numDecks(1), rng(fresh_seed())
+    {
+        init();
+    }
+    Deck(uint8 n) : cardsPerDeck((unsigned) default_deck), numDecks(n), rng(fresh_seed())
     {
         init();
     }
-    Deck(uint8 n) : cardsPerDeck((unsigned) default_deck), numDecks(n)
+    // inject the generator, eg. Deck(Rng(seed)) for a game that can be replayed
+    explicit Deck(const Rng& generator, uint8 n = 1)
+        : cardsPerDeck((unsigned) default_deck), numDecks(n), rng(generator)
     {
         init();
     }
 
     void init() {
-        // this is how to 
-        srand((unsigned) time(nullptr));  // seed rand for later
-        rand();     // this helps on some systems (MSVC)
-
         create_deck();
         shuffle_deck();
     }
+
+    // the same seed always gives the same sequence of shuffles
+    void seed(uint64 s) {
+        rng.reseed(s);
+    }
+
+    Rng& generator() {
+        return rng;
+    }
     
     void create_deck()
     {
         if (numDecks > max_decks) {
-            std::cout<<"\n Too many decks (max 10)";
+            std::cout<<"\n Too many decks (max "<<(unsigned) max_decks<<")";
         } else {
-            if (remainingCardCount>0) {
-                delete_deck();
-            }
-
-            remainingCardCount = numDecks * cardsPerDeck;
+            remainingCardCount = 0;
 
             // for each deck
                 // for each suit
@@ -84,7 +540,7 @@ public:
                 for (uint8 n_suit = 1; n_suit <= suitcount; ++n_suit) {
                     for (uint8 n_rank = 1; n_rank<=rankcount; ++n_rank) {
                         Card temp = {n_suit, n_rank};
-                        deck.push_back(temp);
+                        deck[remainingCardCount++] = temp;
                     }
                 } 
             }
@@ -93,26 +549,24 @@ public:
     
     void delete_deck()
     {
-       if (deck.size() > 0) {
-        bool empty = deck.empty();
-       }
+        remainingCardCount = 0;
     }
     
-        
-    void shuffle_deck() {
-        // use random seed
-        // shuffle each card by that many spaces?
+    // Fisher-Yates over the cards still in the deck
+    void shuffle_deck(Rng& gen) {
         uint16 ncards = remaining();
 
-        for (uint16 i = 0; i<ncards; ++i) {
-            // Shift all elements by r
-            uint16 r = i + (rand() % (ncards - i));
-            if (r != i) {
-                std::swap(deck[r], deck[i]);
-            }
+        for (uint16 i = 0; i + 1 < ncards; ++i) {
+            // pick uniformly from the cards not placed yet
+            uint16 r = i + gen.below(ncards - i);
+            std::swap(deck[r], deck[i]);
         }
     }
 
+    void shuffle_deck() {
+        shuffle_deck(rng);
+    }
+
     // const at end is saying "promise I won't change any member variables"
     uint16 remaining() const {
         return remainingCardCount;
@@ -141,16 +595,14 @@ public:
         return deck[index];
     }
 
+    // cards come off the end, so dealing is just moving the cursor
     const Card deal_card() {
        if (remainingCardCount == 0) {
             std::cout<<" \n Deck: cannot deal from empty deck";
             Card temp={0,0};
             return temp;
         } else {
-            Card returnCard = deck[deck.size()-1];
-            deck.erase(deck.begin()+deck.size()-1);
-            remainingCardCount = deck.size();
-            return returnCard;
+            return deck[--remainingCardCount];
         }
     }
 
@@ -163,17 +615,72 @@ public:
             std::cout<<" \n Deck: cannot deal from empty deck";
             return temp;
         } else {
-            for (int i = 0; i<n; ++i) {
-                Card returnCard = deck[deck.size()-1];
-                deck.erase(deck.begin()+deck.size()-1);
-                temp.push_back(returnCard);
-            }
-
-            remainingCardCount = deck.size();
+            temp.assign(std::reverse_iterator<Card*>(deck + remainingCardCount),
+                        std::reverse_iterator<Card*>(deck + remainingCardCount - n));
+            remainingCardCount -= n;
 
             return temp;
         }
     }
+
+    // the same cards in the same order as deal_hand, into fixed storage
+    template <int Capacity>
+    void deal_hand(CardList<Capacity>& out, uint8 n)
+    {
+        if (remainingCardCount < n) {
+            std::cout<<" \n Deck: cannot deal from empty deck";
+            return;
+        }
+        for (int i = 0; i<n; ++i) {
+            out.push_back(deck[--remainingCardCount]);
+        }
+    }
+
+    // a stock in a chosen order, dealt from the back like any other; lets a search
+    // play a round on from a position it has guessed
+    void load(const Card* cards, uint16 n)
+    {
+        for (uint16 i = 0; i < n; ++i) {
+            deck[i] = cards[i];
+        }
+        remainingCardCount = n;
+    }
+
+    // deal_hand as counts, for shoes where a hand can hold the same card twice
+    CardCounts deal_counts(uint8 n)
+    {
+        if (numDecks == 1) {
+            return CardCounts(deal_mask(n));
+        }
+        CardCounts hand;
+        if (remainingCardCount < n) {
+            std::cout<<" \n Deck: cannot deal from empty deck";
+            return hand;
+        }
+        for (int i = 0; i<n; ++i) {
+            hand.add(card_bit(deck[--remainingCardCount]));
+        }
+        return hand;
+    }
+
+    uint8 packs() const {
+        return numDecks;
+    }
+
+    // deal_hand straight into a bitboard, no vector needed (single-deck only)
+    HandMask deal_mask(uint8 n)
+    {
+        HandMask hand = 0;
+
+        if (remainingCardCount < n) {
+            std::cout<<" \n Deck: cannot deal from empty deck";
+            return hand;
+        }
+        for (int i = 0; i<n; ++i) {
+            hand |= card_bit(deck[--remainingCardCount]);
+        }
+        return hand;
+    }
     
 };
 
@@ -0,0 +1,497 @@
+#ifndef endgame_h
+#define endgame_h
+
+#include "deck.h"
+#include "card_utils.h"
+#include "gin_rummy.h"
+#include "ismcts.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/*
+    Exact endgame solver. Once the stock is down to a handful of cards the rest of
+    the round is small enough to search completely: expectiminimax over draw, discard
+    and knock, with a chance node for every stock draw.
+
+    Both hands are taken as known (a position a search has guessed, or a replayed
+    round), and the stock order is not: each stock draw is any of the cards left in
+    it with equal chance. Seat 0 maximises its points and seat 1 minimises them, the
+    stock-out draw is worth 0, and a knock or gin is scored with score_knock.
+
+    Positions are keyed by Zobrist hashing of where every card is (either hand, or a
+    slot in the discard pile; the stock is whatever is left), the seat to move and
+    the phase.
+
+    Taking the discard doesn't use up the stock, so two seats can pass cards back and
+    forth through the pile for ever. Every draw is open to both seats at every turn,
+    and a position that repeats one earlier in the line (from the position given)
+    ends the round as a draw, worth 0. A stock draw leaves fewer cards in the stock,
+    so no position after it can repeat one before it: what a position just after a
+    stock draw is worth doesn't depend on how it was reached. Only those values go
+    into the EndgameTable shared by every thread of a solve, each one searched with
+    no bounds, so they are exact and the threads can reuse each other's work as is.
+    Between stock draws, in the runs of pile draws, the search is alpha-beta with the
+    line's positions on a stack to spot repeats, and nothing is stored.
+
+    One-pack games only, like SearchTree.
+*/
+
+constexpr int endgame_max_stock = 3;   // deepest stock solve() takes on, see README for timings
+
+// a 64-bit key per (place, card bit): 2 hands, then every slot of the discard pile
+constexpr int zobrist_places = 2 + default_deck;
+
+struct ZobristKeys {
+    uint64 card[zobrist_places][64] = {};
+    uint64 seat = 0;            // xored in when seat 1 is to move
+    uint64 phase[3] = {};       // Draw, Discard, Knock
+};
+
+// splitmix64 again, here so the keys can be built at compile time
+constexpr uint64 zobrist_next(uint64& state) {
+    state += 0x9E3779B97F4A7C15ULL;
+    uint64 z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+constexpr ZobristKeys build_zobrist_keys() {
+    ZobristKeys keys;
+    uint64 state = 0x5A0B12157ULL;
+    for (int place = 0; place < zobrist_places; ++place) {
+        for (int bit = 0; bit < 64; ++bit) {
+            keys.card[place][bit] = zobrist_next(state);
+        }
+    }
+    keys.seat = zobrist_next(state);
+    for (int p = 0; p < 3; ++p) {
+        keys.phase[p] = zobrist_next(state);
+    }
+    return keys;
+}
+
+constexpr ZobristKeys zobrist_keys = build_zobrist_keys();
+
+/*
+    Fixed-size transposition table that any number of threads can read and write with
+    no lock. An entry is two words, the value and the key xored with the value, both
+    written with relaxed stores. A reader that sees half of one write and half of
+    another gets words that don't xor back to its key and treats it as a miss, so a
+    torn entry is never used. Every store replaces what was there.
+*/
+class EndgameTable
+{
+private:
+    struct Entry {
+        std::atomic<uint64> check;
+        std::atomic<uint64> value;
+    };
+
+    std::unique_ptr<Entry[]> entries;
+    uint64 mask;
+
+    static uint64 bits_of(double v) {
+        uint64 bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        return bits;
+    }
+
+public:
+    // 2^log2Entries entries of 16 bytes, 16 MB by default
+    explicit EndgameTable(int log2Entries = 20)
+        : entries(new Entry[size_t(1) << log2Entries]), mask((uint64(1) << log2Entries) - 1) {
+        clear();
+    }
+
+    void clear() {
+        for (uint64 i = 0; i <= mask; ++i) {
+            entries[i].check.store(0, std::memory_order_relaxed);
+            entries[i].value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    bool probe(uint64 key, double& value) const {
+        const Entry& e = entries[key & mask];
+        uint64 v = e.value.load(std::memory_order_relaxed);
+        uint64 check = e.check.load(std::memory_order_relaxed);
+        if ((check ^ v) != key) {
+            return false;
+        }
+        std::memcpy(&value, &v, sizeof(value));
+        return true;
+    }
+
+    void store(uint64 key, double value) {
+        Entry& e = entries[key & mask];
+        uint64 v = bits_of(value);
+        e.check.store(key ^ v, std::memory_order_relaxed);
+        e.value.store(v, std::memory_order_relaxed);
+    }
+};
+
+// one move at the root and what it is worth, in points to the seat to move
+struct EndgameOption {
+    uint8 action;       // SearchAction: a draw, ActDiscard + card bit, or the knock answer
+    double value;
+};
+
+/*
+    A position as the solver walks it. Small enough to copy into every call, which is
+    simpler than undoing moves and keeps the key in step with the cards.
+*/
+struct EndgameState {
+    HandMask hands[2];
+    HandMask stock;
+    Card pile[default_deck];
+    uint8 pileCount;
+    uint8 toMove;
+    Round::Phase phase;
+    int deadwood;       // the mover's deadwood, valid in the Knock phase
+    uint64 key;
+
+    void move_card(int place, HandMask bit, bool in) {
+        if (in) {
+            hands[place] |= bit;
+        } else {
+            hands[place] &= ~bit;
+        }
+        key ^= zobrist_keys.card[place][__builtin_ctzll(bit)];
+    }
+
+    void push_pile(Card c) {
+        key ^= zobrist_keys.card[2 + pileCount][__builtin_ctzll(card_bit(c))];
+        pile[pileCount++] = c;
+    }
+
+    Card pop_pile() {
+        Card c = pile[--pileCount];
+        key ^= zobrist_keys.card[2 + pileCount][__builtin_ctzll(card_bit(c))];
+        return c;
+    }
+
+    void set_phase(Round::Phase p) {
+        key ^= zobrist_keys.phase[phase] ^ zobrist_keys.phase[p];
+        phase = p;
+    }
+
+    void pass_turn() {
+        toMove = uint8(1 - toMove);
+        key ^= zobrist_keys.seat;
+    }
+};
+
+class EndgameSolver
+{
+private:
+    EndgameTable& table;
+    unsigned threads;
+    std::atomic<uint64> nodes{0};
+
+    static constexpr double unbounded = std::numeric_limits<double>::infinity();
+
+    /*
+        The keys of the positions on the line being searched, one stack per thread.
+        from is where the positions since the last stock draw start: nothing before
+        it can come round again.
+    */
+    struct Line {
+        std::vector<uint64> keys;
+        size_t from = 0;
+
+        bool repeats(uint64 key) const {
+            for (size_t i = from; i < keys.size(); ++i) {
+                if (keys[i] == key) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    // seat 0's points for a round scored now, with the mover knocking
+    static double knock_value(const EndgameState& s) {
+        HandMask defender = s.hands[1 - s.toMove];
+        int opponent = s.deadwood ? resolve_layoffs(s.hands[s.toMove], defender).deadwood
+                                  : min_deadwood(defender);
+        RoundResult result = knock_result(s.toMove, s.deadwood, opponent, 0);
+        return result.winner == 0 ? result.points : -result.points;
+    }
+
+    // the end of a turn: the other seat draws, or the stock is out and nobody scores
+    double after_turn(EndgameState s, double alpha, double beta, Line& line, uint64& count) {
+        if (!s.stock) {
+            return 0;
+        }
+        s.pass_turn();
+        s.set_phase(Round::Draw);
+        return value(s, alpha, beta, line, count);
+    }
+
+    // deadwood is what the mover's hand is left with, worked out by the caller
+    double after_discard(EndgameState s, HandMask bit, int deadwood, double alpha, double beta,
+                         Line& line, uint64& count) {
+        s.move_card(s.toMove, bit, false);
+        s.push_pile(bit_card(__builtin_ctzll(bit)));
+        s.deadwood = deadwood;
+        if (s.deadwood == 0) {
+            return knock_value(s);
+        }
+        if (s.deadwood <= knock_limit) {
+            s.set_phase(Round::Knock);
+            return value(s, alpha, beta, line, count);
+        }
+        return after_turn(s, alpha, beta, line, count);
+    }
+
+    // the position after drawing bit from the stock, from the table or searched with no bounds
+    double after_stock_draw(EndgameState s, HandMask bit, Line& line, uint64& count) {
+        s.stock &= ~bit;
+        s.move_card(s.toMove, bit, true);
+        s.set_phase(Round::Discard);
+        double stored;
+        if (table.probe(s.key, stored)) {
+            return stored;
+        }
+        size_t outer = line.from;
+        line.from = line.keys.size();
+        double v = value(s, -unbounded, unbounded, line, count);
+        line.from = outer;
+        table.store(s.key, v);
+        return v;
+    }
+
+    // drawing from the stock: every card left in it, with equal chance
+    double stock_draw(const EndgameState& s, Line& line, uint64& count) {
+        double total = 0;
+        for (HandMask rest = s.stock; rest; rest &= rest - 1) {
+            total += after_stock_draw(s, rest & -rest, line, count);
+        }
+        return total / card_count(s.stock);
+    }
+
+    double pile_draw(EndgameState s, double alpha, double beta, Line& line, uint64& count) {
+        HandMask bit = card_bit(s.pop_pile());
+        s.move_card(s.toMove, bit, true);
+        s.set_phase(Round::Discard);
+        return value(s, alpha, beta, line, count);
+    }
+
+    /*
+        Seat 0's expected points from s with both seats playing their best from here,
+        when that is inside (alpha, beta); otherwise a bound past the side of the
+        window it fell on. With no bounds it is exact.
+    */
+    double value(const EndgameState& s, double alpha, double beta, Line& line, uint64& count) {
+        if (line.repeats(s.key)) {
+            return 0;
+        }
+        ++count;
+        line.keys.push_back(s.key);
+
+        bool maximise = s.toMove == 0;
+        double v = maximise ? -unbounded : unbounded;
+        // true once the moves left can't change what the line above chooses
+        auto consider = [&](double option) {
+            if (maximise) {
+                v = std::max(v, option);
+                alpha = std::max(alpha, v);
+            } else {
+                v = std::min(v, option);
+                beta = std::min(beta, v);
+            }
+            return alpha >= beta;
+        };
+
+        switch (s.phase) {
+            case Round::Draw:
+                if (!consider(stock_draw(s, line, count)) && s.pileCount > 0) {
+                    consider(pile_draw(s, alpha, beta, line, count));
+                }
+                break;
+            case Round::Discard: {
+                // every discard's deadwood in one batch, as BotPolicy scores them, and
+                // the least deadwood first since it is most often the best
+                DiscardChoice choices[default_deck];
+                int n = evaluate_discards(s.hands[s.toMove], choices);
+                std::stable_sort(choices, choices + n,
+                                 [](const DiscardChoice& a, const DiscardChoice& b) {
+                                     return a.deadwood < b.deadwood;
+                                 });
+                for (int i = 0; i < n; ++i) {
+                    if (consider(after_discard(s, card_bit(choices[i].card), choices[i].deadwood,
+                                               alpha, beta, line, count))) {
+                        break;
+                    }
+                }
+                break;
+            }
+            case Round::Knock:
+                if (!consider(knock_value(s))) {
+                    consider(after_turn(s, alpha, beta, line, count));
+                }
+                break;
+            case Round::Over:
+                v = 0;
+                break;
+        }
+        line.keys.pop_back();
+        return v;
+    }
+
+    /*
+        The root is split into work items the threads take in turn: one per stock card
+        for a draw (so even the two draw options keep every thread busy), one per
+        card for a discard and one per answer for a knock. Each is searched with no
+        bounds, so its value is exact.
+    */
+    struct WorkItem {
+        uint8 action;
+        HandMask bit;   // the stock card drawn, or the card thrown
+    };
+
+    double run_item(const EndgameState& root, const WorkItem& item, Line& line, uint64& count) {
+        switch (item.action) {
+            case ActDrawStock:
+                return after_stock_draw(root, item.bit, line, count);
+            case ActDrawDiscard:
+                return pile_draw(root, -unbounded, unbounded, line, count);
+            case ActPlayOn:
+                return after_turn(root, -unbounded, unbounded, line, count);
+            case ActKnock:
+                return knock_value(root);
+            default:
+                return after_discard(root, item.bit,
+                                     min_deadwood(root.hands[root.toMove] & ~item.bit),
+                                     -unbounded, unbounded, line, count);
+        }
+    }
+
+public:
+    // threads 0 = every core; several solvers may share one table
+    explicit EndgameSolver(EndgameTable& t, unsigned threads = 0) : table(t), threads(threads) {
+        if (this->threads == 0) {
+            this->threads = std::thread::hardware_concurrency();
+        }
+        if (this->threads == 0) {
+            this->threads = 1;
+        }
+    }
+
+    // false for a shoe, or for a position whose cards don't account for the whole pack
+    static bool can_solve(const Round& round) {
+        if (round.phase() == Round::Over || round.counts(0).repeated() ||
+            round.counts(1).repeated()) {
+            return false;
+        }
+        HandMask seen = round.hand(0) | round.hand(1);
+        for (int i = 0; i < round.discard_count(); ++i) {
+            seen |= card_bit(round.discard_pile()[i]);
+        }
+        return card_count(all_cards & ~seen) == round.stock_remaining();
+    }
+
+    /*
+        Fills out with every move open to the seat to move and what it is worth to
+        that seat, and returns how many there are: the two draws, each discard, or
+        the knock answer. Returns 0 when the position can't be solved or the stock
+        holds more than maxStock cards.
+    */
+    int solve(const Round& round, EndgameOption* out, int maxStock = endgame_max_stock) {
+        if (!can_solve(round) || round.stock_remaining() > maxStock) {
+            return 0;
+        }
+
+        EndgameState root;
+        root.hands[0] = round.hand(0);
+        root.hands[1] = round.hand(1);
+        root.pileCount = 0;
+        root.toMove = uint8(round.to_move());
+        root.phase = round.phase();
+        root.deadwood = round.deadwood();
+        root.key = zobrist_keys.phase[root.phase] ^ (root.toMove ? zobrist_keys.seat : 0);
+        for (int seat = 0; seat < 2; ++seat) {
+            for (HandMask rest = root.hands[seat]; rest; rest &= rest - 1) {
+                root.key ^= zobrist_keys.card[seat][__builtin_ctzll(rest)];
+            }
+        }
+        HandMask seen = root.hands[0] | root.hands[1];
+        for (int i = 0; i < round.discard_count(); ++i) {
+            seen |= card_bit(round.discard_pile()[i]);
+            root.push_pile(round.discard_pile()[i]);
+        }
+        root.stock = all_cards & ~seen;
+
+        WorkItem items[default_deck + 1];
+        int itemCount = 0;
+        switch (root.phase) {
+            case Round::Draw:
+                for (HandMask rest = root.stock; rest; rest &= rest - 1) {
+                    items[itemCount++] = {ActDrawStock, rest & -rest};
+                }
+                if (root.pileCount > 0) {
+                    items[itemCount++] = {ActDrawDiscard, 0};
+                }
+                break;
+            case Round::Discard:
+                for (HandMask rest = root.hands[root.toMove]; rest; rest &= rest - 1) {
+                    items[itemCount++] = {uint8(ActDiscard + __builtin_ctzll(rest)), rest & -rest};
+                }
+                break;
+            case Round::Knock:
+                items[itemCount++] = {ActPlayOn, 0};
+                items[itemCount++] = {ActKnock, 0};
+                break;
+            case Round::Over:
+                break;
+        }
+
+        double values[default_deck + 1];
+        std::atomic<int> next{0};
+        auto work = [&] {
+            uint64 count = 0;
+            Line line;
+            line.keys.push_back(root.key);
+            for (int i = next++; i < itemCount; i = next++) {
+                values[i] = run_item(root, items[i], line, count);
+            }
+            nodes += count;
+        };
+        std::vector<std::thread> helpers;
+        for (unsigned t = 1; t < threads && t < unsigned(itemCount); ++t) {
+            helpers.emplace_back(work);
+        }
+        work();
+        for (std::thread& h : helpers) {
+            h.join();
+        }
+
+        // the stock draws average into one option; values turn to the mover's side
+        double sign = root.toMove == 0 ? 1 : -1;
+        int count = 0;
+        double stockTotal = 0;
+        for (int i = 0; i < itemCount; ++i) {
+            if (items[i].action == ActDrawStock) {
+                stockTotal += values[i];
+            } else {
+                out[count++] = {items[i].action, sign * values[i]};
+            }
+        }
+        if (root.phase == Round::Draw) {
+            out[count++] = {ActDrawStock, sign * stockTotal / card_count(root.stock)};
+        }
+        return count;
+    }
+
+    // positions searched (not found in the table) by every solve so far
+    uint64 nodes_searched() const {
+        return nodes.load();
+    }
+};
+
+#endif /* endgame_h */
@@ -0,0 +1,326 @@
+#ifndef engine_protocol_h
+#define engine_protocol_h
+
+#include "deck.h"
+#include "card_utils.h"
+#include "gin_rummy.h"
+#include "game_io.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/*
+    A line protocol for driving the game from another program, in the spirit of UCI
+    for chess engines (gin_rummy --engine). The driver plays both seats, or hands
+    any decision to the built-in bot with go. Commands, one a line:
+
+        newgame [seed S] [decks D] [hand N]   start a match and deal its first round
+        newround                              deal the next round once one is over
+        state [seat]                          the position as a seat sees it (default: the one to move)
+        draw stock|discard
+        discard <card>                        7H, TS, ...
+        knock | pass                          take or turn down the offer to knock
+        go                                    the bot makes the move for the seat to move
+        isready                               readyok, once everything before it is answered
+        quit
+
+    Replies, one line each (go answers "move <command>" and then that command's reply):
+
+        round <n> seed <s> first <seat>
+        state <phase> seat <s> turn <t> stock <n> top <card|--> hand <cards> deadwood <d> scores <a> <b>
+        drew <card>
+        ok <phase> seat <s>                   the move is made, this is what comes next
+        result <end> knocker <k> winner <w> points <p> deadwood <a> <b> laidoff <cards|-> scores <a> <b>
+        gameover <seat|-1>                    after the result of the round that ends the match
+        error <text>
+
+    Replies are collected and written out only when the driver has nothing more
+    waiting to be read, so a driver that sends a batch of commands gets one write
+    back instead of one per line.
+*/
+
+class EngineSession
+{
+private:
+    Deck deck;
+    Round round;
+    BotPolicy bot;
+    RoundObserver* observer;
+    int handSize = standard_hand_size;
+    int scores[2] = {0, 0};
+    int roundNumber = 0;
+    bool matchOver = true;
+    std::string out;
+
+    static const char* phase_word(Round::Phase phase) {
+        switch (phase) {
+            case Round::Draw: return "draw";
+            case Round::Discard: return "discard";
+            case Round::Knock: return "knock";
+            case Round::Over: return "over";
+        }
+        return "?";
+    }
+
+    void reply(const std::string& line) {
+        out += line;
+        out += '\n';
+    }
+
+    // a seat's hand with every copy of a card it holds more than once
+    std::string hand_text(int seat) const {
+        const CardCounts& counts = round.counts(seat);
+        std::string text;
+        for (HandMask rest = counts.held(); rest; rest &= rest - 1) {
+            HandMask bit = rest & -rest;
+            for (int copy = counts.count(bit); copy > 0; --copy) {
+                text += (text.empty() ? "" : " ") + card_name(bit_card(__builtin_ctzll(bit)));
+            }
+        }
+        return text;
+    }
+
+    std::string scores_text() const {
+        return std::to_string(scores[0]) + " " + std::to_string(scores[1]);
+    }
+
+    void deal() {
+        ++roundNumber;
+        int first = (roundNumber - 1) % 2;
+        // each round gets its own seed the way GameEngine does, so the same seed
+        // deals the same rounds as a tournament or a bench run
+        uint64 roundSeed = deck.generator().next();
+        deck.seed(roundSeed);
+        deck.new_deck();
+        round.deal(deck, handSize, first);
+        if (observer) {
+            observer->begin(roundSeed, handSize, first, deck.packs());
+        }
+        reply("round " + std::to_string(roundNumber) + " seed " + std::to_string(roundSeed) +
+              " first " + std::to_string(first));
+    }
+
+    // after a move: either what comes next, or how the round ended
+    void report_move() {
+        if (round.phase() != Round::Over) {
+            reply(std::string("ok ") + phase_word(round.phase()) + " seat " +
+                  std::to_string(round.to_move()));
+            return;
+        }
+        const RoundResult& r = round.result();
+        if (observer) {
+            observer->end(r);
+        }
+        count_round(r);
+        if (r.winner >= 0) {
+            scores[r.winner] += r.points;
+        }
+        reply(std::string("result ") + round_end_words[uint8(r.type)] + " knocker " +
+              std::to_string(r.knocker) + " winner " + std::to_string(r.winner) + " points " +
+              std::to_string(r.points) + " deadwood " + std::to_string(r.knockerDeadwood) + " " +
+              std::to_string(r.opponentDeadwood) + " laidoff " +
+              (r.laidOff ? mask_text(r.laidOff) : "-") + " scores " + scores_text());
+        if (scores[0] >= game_target || scores[1] >= game_target || roundNumber >= max_match_rounds) {
+            matchOver = true;
+            int winner = scores[0] == scores[1] ? -1 : scores[0] > scores[1] ? 0 : 1;
+            reply("gameover " + std::to_string(winner));
+        }
+    }
+
+    void new_game(std::istringstream& args) {
+        uint64 seed = fresh_seed();
+        unsigned decks = 1;
+        int cards = standard_hand_size;
+        std::string key;
+        while (args >> key) {
+            if (key == "seed" && args >> seed) {
+            } else if (key == "decks" && args >> decks && decks >= 1 && decks <= max_decks) {
+            } else if (key == "hand" && args >> cards && cards >= 1) {
+            } else {
+                reply("error newgame takes seed S, decks 1-" + std::to_string(max_decks) +
+                      " and hand N");
+                return;
+            }
+        }
+        if (2 * cards + 1 > int(decks * default_deck)) {
+            reply("error " + std::to_string(decks) + " packs can't deal two hands of " +
+                  std::to_string(cards));
+            return;
+        }
+        deck.new_deck(uint8(decks));
+        deck.seed(seed);
+        handSize = cards;
+        scores[0] = scores[1] = 0;
+        roundNumber = 0;
+        matchOver = false;
+        deal();
+    }
+
+    void state(std::istringstream& args) {
+        int seat = round.to_move();
+        if (args >> seat && seat != 0 && seat != 1) {
+            reply("error no seat " + std::to_string(seat));
+            return;
+        }
+        reply(std::string("state ") + phase_word(round.phase()) + " seat " + std::to_string(seat) +
+              " turn " + std::to_string(round.turns()) + " stock " +
+              std::to_string(round.stock_remaining()) + " top " +
+              (round.has_discard() ? card_name(round.top_discard()) : "--") + " hand " +
+              hand_text(seat) + " deadwood " + std::to_string(min_deadwood(round.counts(seat))) +
+              " scores " + scores_text());
+    }
+
+    void draw(bool fromDiscard) {
+        uint16 stockBefore = round.stock_remaining();
+        Card drawn;
+        round.draw(fromDiscard, drawn);
+        if (observer) {
+            // draw() falls back to the other pile when the chosen one is empty
+            observer->draw(round.stock_remaining() == stockBefore, drawn);
+        }
+        reply("drew " + card_name(drawn));
+    }
+
+    void discard(Card c) {
+        if (!round.discard(c)) {
+            reply("error " + card_name(c) + " isn't in the hand");
+            return;
+        }
+        if (observer) {
+            observer->discard(c);
+            if (round.result().knocker >= 0) {
+                observer->knock(true);  // gin
+            }
+        }
+        report_move();
+    }
+
+    void knock(bool yes) {
+        round.knock(yes);
+        if (observer) {
+            observer->knock(yes);
+        }
+        report_move();
+    }
+
+    // the bot's decision, played and reported like the driver's own
+    void go() {
+        TurnView view = turn_view(round);
+        if (round.phase() == Round::Draw) {
+            bool fromDiscard = bot.draw_from_discard(view);
+            reply(fromDiscard ? "move draw discard" : "move draw stock");
+            draw(fromDiscard);
+        } else if (round.phase() == Round::Discard) {
+            Card pick = bot.choose_discard(view);
+            reply("move discard " + card_name(pick));
+            discard(pick);
+        } else {
+            bool yes = bot.knock(view, round.deadwood());
+            reply(yes ? "move knock" : "move pass");
+            knock(yes);
+        }
+    }
+
+public:
+    // observer, if given, hears every round the way GameEngine reports them (eg. a RoundLog)
+    explicit EngineSession(RoundObserver* o = nullptr) : observer(o) {}
+
+    /*
+        Runs one command line and queues its replies; false for quit. A move that
+        isn't legal in the current phase is answered with an error and changes nothing.
+    */
+    bool command(const std::string& line) {
+        std::istringstream args(line);
+        std::string word;
+        if (!(args >> word)) {
+            return true;
+        }
+        if (word == "quit") {
+            return false;
+        } else if (word == "isready") {
+            reply("readyok");
+        } else if (word == "newgame") {
+            new_game(args);
+        } else if (word == "newround") {
+            if (matchOver) {
+                reply("error no match, send newgame");
+            } else if (round.phase() != Round::Over) {
+                reply("error the round isn't over");
+            } else {
+                deal();
+            }
+        } else if (roundNumber == 0) {
+            reply("error no match, send newgame");
+        } else if (word == "state") {
+            state(args);
+        } else if (word == "go") {
+            if (round.phase() == Round::Over) {
+                reply("error the round is over");
+            } else {
+                go();
+            }
+        } else if (word == "draw") {
+            std::string pile;
+            args >> pile;
+            if (round.phase() != Round::Draw) {
+                reply(std::string("error not the draw, it's the ") + phase_word(round.phase()));
+            } else if (pile != "stock" && pile != "discard") {
+                reply("error draw stock or draw discard");
+            } else {
+                draw(pile == "discard");
+            }
+        } else if (word == "discard") {
+            std::string text;
+            Card c;
+            args >> text;
+            if (round.phase() != Round::Discard) {
+                reply(std::string("error not the discard, it's the ") + phase_word(round.phase()));
+            } else if (!parse_card(text, c)) {
+                reply("error not a card: " + text);
+            } else {
+                discard(c);
+            }
+        } else if (word == "knock" || word == "pass") {
+            if (round.phase() != Round::Knock) {
+                reply(std::string("error no knock to answer, it's the ") + phase_word(round.phase()));
+            } else {
+                knock(word == "knock");
+            }
+        } else {
+            reply("error unknown command " + word);
+        }
+        return true;
+    }
+
+    // the replies queued since the last call
+    std::string take_output() {
+        std::string text;
+        text.swap(out);
+        return text;
+    }
+};
+
+/*
+    Serves the protocol on in/out until quit or end of input. Output is written
+    whenever in has nothing more buffered, so a batch of commands is answered with
+    one write.
+*/
+inline int run_engine(std::istream& in, std::ostream& out, RoundObserver* observer = nullptr) {
+    EngineSession session(observer);
+    std::string line;
+    bool running = true;
+    while (running && std::getline(in, line)) {
+        running = session.command(line);
+        if (!running || in.rdbuf()->in_avail() <= 0) {
+            std::string text = session.take_output();
+            out.write(text.data(), std::streamsize(text.size()));
+            out.flush();
+        }
+    }
+    std::string text = session.take_output();
+    out.write(text.data(), std::streamsize(text.size()));
+    out.flush();
+    return 0;
+}
+
+#endif /* engine_protocol_h */
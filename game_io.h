@@ -0,0 +1,249 @@
+#ifndef game_io_h
+#define game_io_h
+
+#include "deck.h"
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Terminal output for the interactive game. Lines are collected while a turn is
+    played and handed over in one flush; when there are delays a pacer thread
+    writes them out on a timer, so the game thread goes straight back to reading
+    input instead of sleeping in front of every line.
+*/
+
+enum class Pace : uint8 {
+    Normal,     // a pause before every narrated line, as the game was first written
+    Fast,       // same, with a quarter of the pause
+    Instant,    // no pauses
+    Quiet       // no pauses and only prompts, input errors and results
+};
+
+// --fast, --instant or --quiet; false for anything else
+inline bool parse_pace(const std::string& flag, Pace& pace) {
+    if (flag == "--fast") {
+        pace = Pace::Fast;
+    } else if (flag == "--instant") {
+        pace = Pace::Instant;
+    } else if (flag == "--quiet") {
+        pace = Pace::Quiet;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// operator<< for Card can't be chained, so build the text once here
+inline std::string card_name(const Card& c) {
+    std::ostringstream o;
+    o << c;
+    return o.str();
+}
+
+// the inverse of card_name: "7H", "TS", "qd"... false if the text isn't a card
+inline bool parse_card(const std::string& text, Card& c) {
+    if (text.size() != 2) {
+        return false;
+    }
+    char rank = char(toupper((unsigned char) text[0]));
+    char suit = char(toupper((unsigned char) text[1]));
+    size_t s = suitstr.find(suit);
+    if (s == std::string::npos || s == 0) {
+        return false;
+    }
+    c.suit = uint8(s);
+    if (rank >= '2' && rank <= '9') {
+        c.rank = uint8(rank - '0');
+    } else if (rank == facecards[0]) {
+        c.rank = 1;
+    } else {
+        size_t f = facecards.find(rank);
+        if (f == std::string::npos) {
+            return false;
+        }
+        c.rank = uint8(f + 9);  // T is 10, J 11, Q 12, K 13
+    }
+    return true;
+}
+
+// the cards of a mask as "2C 3C 9H", in mask order
+inline std::string mask_text(HandMask hand) {
+    std::string text;
+    while (hand) {
+        if (!text.empty()) {
+            text += ' ';
+        }
+        text += card_name(bit_card(__builtin_ctzll(hand)));
+        hand &= hand - 1;
+    }
+    return text;
+}
+
+class Renderer
+{
+private:
+    struct Chunk {
+        int delayMs;        // wait this long before writing it
+        uint64 number;      // position in the queue, for hurry()
+        std::string text;
+    };
+
+    Pace pace = Pace::Normal;
+    int delayMs = 0;
+
+    std::vector<Chunk> turn;        // only touched by the game thread
+
+    // shared with the pacer
+    std::mutex lock;
+    std::condition_variable wake, idle;
+    std::deque<Chunk> queue;
+    uint64 queued = 0;
+    uint64 hurried = 0;             // chunks up to this number skip their wait
+    bool writing = false;
+    bool stopping = false;
+    std::thread pacer;
+
+    void add(const std::string& text, bool newline, bool paced, bool always) {
+        if (pace == Pace::Quiet && !always) {
+            return;
+        }
+        // unpaced text rides along with whatever came before it
+        if (turn.empty() || (paced && delayMs > 0)) {
+            turn.push_back({paced ? delayMs : 0, 0, std::string()});
+        }
+        turn.back().text += text;
+        if (newline) {
+            turn.back().text += '\n';
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            Chunk chunk = std::move(queue.front());
+            queue.pop_front();
+            writing = true;
+            if (chunk.delayMs > 0) {
+                wake.wait_for(guard, std::chrono::milliseconds(chunk.delayMs),
+                              [&] { return stopping || chunk.number <= hurried; });
+            }
+            guard.unlock();
+            std::cout << chunk.text << std::flush;
+            guard.lock();
+            writing = false;
+            if (queue.empty()) {
+                idle.notify_all();
+            }
+        }
+    }
+
+public:
+    Renderer() {}
+    Renderer(const Renderer&) = delete;
+    Renderer& operator=(const Renderer&) = delete;
+
+    ~Renderer() {
+        drain();
+        if (pacer.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            wake.notify_all();
+            pacer.join();
+        }
+    }
+
+    // pick the mode once, before anything is printed
+    void set_pace(Pace p, int normalDelayMs) {
+        pace = p;
+        delayMs = p == Pace::Normal ? normalDelayMs : p == Pace::Fast ? normalDelayMs / 4 : 0;
+        if (delayMs > 0 && !pacer.joinable()) {
+            pacer = std::thread(&Renderer::run, this);
+        }
+    }
+
+    // narration, paced
+    void say(const std::string& text, bool newline = true) {
+        add(text, newline, true, false);
+    }
+
+    // details that follow a narrated line straight away (hands, card names)
+    void show(const std::string& text, bool newline = true) {
+        add(text, newline, false, false);
+    }
+
+    // outcomes (points scored, who won): paced, and shown in every mode
+    void result(const std::string& text, bool newline = true) {
+        add(text, newline, true, true);
+    }
+
+    // shown straight away in every mode, quiet included
+    void alert(const std::string& text, bool newline = true) {
+        add(text, newline, false, true);
+    }
+
+    // a question for the player: it goes out with everything before it, and the
+    // caller can start reading the answer right away
+    void prompt(const std::string& text) {
+        add(text, false, false, true);
+        flush();
+    }
+
+    // hand the turn's output over in one go
+    void flush() {
+        if (turn.empty()) {
+            return;
+        }
+        if (!pacer.joinable()) {
+            std::string all;
+            for (const Chunk& chunk : turn) {
+                all += chunk.text;
+            }
+            std::cout << all << std::flush;
+        } else {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                for (Chunk& chunk : turn) {
+                    chunk.number = ++queued;
+                    queue.push_back(std::move(chunk));
+                }
+            }
+            wake.notify_one();
+        }
+        turn.clear();
+    }
+
+    // the player has answered, so whatever is still waiting is written without pauses
+    void hurry() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            hurried = queued;
+        }
+        wake.notify_all();
+    }
+
+    // wait until everything handed over so far is on the screen
+    void drain() {
+        flush();
+        if (!pacer.joinable()) {
+            return;
+        }
+        std::unique_lock<std::mutex> guard(lock);
+        idle.wait(guard, [&] { return queue.empty() && !writing; });
+    }
+};
+
+#endif /* game_io_h */
@@ -0,0 +1,359 @@
+#ifndef game_log_h
+#define game_log_h
+
+#include "deck.h"
+#include "card_utils.h"
+#include "gin_rummy.h"
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+    Append-only binary log of played rounds.
+
+    file:   8-byte magic, then rounds back to back
+    round:  a 24-byte LogRound, then eventCount one-byte events
+    event:  top 2 bits are the LogEvent, low 6 bits the card's bit index in a
+            HandMask (card_bit), which always fits
+
+    The deal isn't stored, only its seed: Deck(Rng(seed)) shuffles the same way
+    every time, so replay_round deals the round again and plays the events on top.
+    A 10-card round is typically 24 + 30-60 bytes.
+
+    The reader maps the file and hands out pointers into it, nothing is copied or
+    parsed beyond the 24-byte header. POSIX only (mmap).
+*/
+
+constexpr char log_magic[8] = {'G', 'I', 'N', 'L', 'O', 'G', 1, 0};
+
+enum class LogEvent : uint8 {
+    DrawStock,      // card = the card drawn
+    DrawDiscard,    // card = the card taken
+    Discard,        // card = the card thrown
+    Knock           // payload 1 = knocked or went gin, 0 = played on
+};
+
+struct LogRound {
+    uint64 seed;
+    uint16 eventCount;
+    uint16 turns;
+    uint16 points;
+    uint8 handSize;
+    uint8 firstSeat;
+    uint8 end;                  // RoundEnd
+    int8_t knocker;             // -1 if the stock ran out
+    int8_t winner;              // -1 if nobody scored
+    uint8 knockerDeadwood;
+    uint8 opponentDeadwood;
+    uint8 decks;                // packs in the shoe; 0 (logs from before shoes) means 1
+    uint8 rules;                // log_rule_* flags the round was scored under
+    uint8 reserved;
+};
+static_assert(sizeof(LogRound) == 24, "LogRound is written to disk as is");
+
+// the defender laid off on the knocker's melds (rounds logged before layoffs have 0)
+constexpr uint8 log_rule_layoffs = 1;
+
+inline uint8 pack_event(LogEvent type, uint8 payload) {
+    return uint8((uint8(type) << 6) | payload);
+}
+inline uint8 pack_event(LogEvent type, Card c) {
+    return pack_event(type, uint8(__builtin_ctzll(card_bit(c))));
+}
+inline LogEvent event_type(uint8 e) { return LogEvent(e >> 6); }
+inline uint8 event_payload(uint8 e) { return e & 63; }
+inline Card event_card(uint8 e) { return bit_card(e & 63); }
+
+class RoundLog;
+
+// one file, shared by any number of RoundLogs (appends are locked, so threads can share it)
+class GameLogWriter
+{
+private:
+    FILE* file = nullptr;
+    std::mutex lock;
+
+public:
+    GameLogWriter() {}
+    GameLogWriter(const GameLogWriter&) = delete;
+    GameLogWriter& operator=(const GameLogWriter&) = delete;
+    ~GameLogWriter() {
+        close();
+    }
+
+    // appends to an existing log, starts a new one otherwise
+    bool open(const std::string& path) {
+        close();
+        if (FILE* existing = fopen(path.c_str(), "rb")) {
+            char magic[sizeof(log_magic)];
+            size_t got = fread(magic, 1, sizeof(magic), existing);
+            fclose(existing);
+            if (got > 0 && (got != sizeof(magic) || memcmp(magic, log_magic, sizeof(magic)) != 0)) {
+                return false;   // something else lives here, don't append to it
+            }
+        }
+        file = fopen(path.c_str(), "ab");
+        if (!file) {
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        if (ftell(file) == 0) {
+            fwrite(log_magic, 1, sizeof(log_magic), file);
+        }
+        return true;
+    }
+
+    bool is_open() const {
+        return file != nullptr;
+    }
+
+    void close() {
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+    void append(const LogRound& header, const uint8* events) {
+        if (!file) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(events, 1, header.eventCount, file);
+    }
+};
+
+// collects one round's events and appends the round to the writer when it ends
+class RoundLog : public RoundObserver
+{
+private:
+    GameLogWriter* writer;
+    LogRound header;
+    std::vector<uint8> events;
+
+    void add(uint8 e) {
+        if (events.size() < 0xFFFF) {
+            events.push_back(e);
+        }
+    }
+
+public:
+    explicit RoundLog(GameLogWriter& out) : writer(&out) {
+        events.reserve(256);
+    }
+
+    void begin(uint64 seed, int handSize, int firstSeat, int decks) override {
+        memset(&header, 0, sizeof(header));
+        header.seed = seed;
+        header.handSize = uint8(handSize);
+        header.firstSeat = uint8(firstSeat);
+        header.decks = uint8(decks);
+        header.rules = log_rule_layoffs;
+        events.clear();
+    }
+
+    void draw(bool fromDiscard, Card drawn) override {
+        add(pack_event(fromDiscard ? LogEvent::DrawDiscard : LogEvent::DrawStock, drawn));
+    }
+
+    void discard(Card c) override {
+        add(pack_event(LogEvent::Discard, c));
+    }
+
+    void knock(bool yes) override {
+        add(pack_event(LogEvent::Knock, uint8(yes ? 1 : 0)));
+    }
+
+    void end(const RoundResult& result) override {
+        header.eventCount = uint16(events.size());
+        header.turns = uint16(result.turns);
+        header.points = uint16(result.points);
+        header.end = uint8(result.type);
+        header.knocker = int8_t(result.knocker);
+        header.winner = int8_t(result.winner);
+        header.knockerDeadwood = uint8(result.knockerDeadwood);
+        header.opponentDeadwood = uint8(result.opponentDeadwood);
+        writer->append(header, events.data());
+    }
+};
+
+// a round as it sits in the mapped file; events points into the mapping
+struct LoggedRound {
+    LogRound header;
+    const uint8* events;
+};
+
+class GameLogReader
+{
+private:
+    const uint8* data = nullptr;
+    size_t bytes = 0;
+    size_t cursor = 0;
+
+public:
+    GameLogReader() {}
+    GameLogReader(const GameLogReader&) = delete;
+    GameLogReader& operator=(const GameLogReader&) = delete;
+    ~GameLogReader() {
+        close();
+    }
+
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(log_magic)) {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);    // the mapping keeps the file alive
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        data = static_cast<const uint8*>(mapped);
+        bytes = size_t(info.st_size);
+        madvise(mapped, bytes, MADV_SEQUENTIAL);
+
+        if (memcmp(data, log_magic, sizeof(log_magic)) != 0) {
+            close();
+            return false;
+        }
+        rewind();
+        return true;
+    }
+
+    void close() {
+        if (data) {
+            munmap(const_cast<uint8*>(data), bytes);
+            data = nullptr;
+            bytes = 0;
+            cursor = 0;
+        }
+    }
+
+    size_t size() const {
+        return bytes;
+    }
+
+    void rewind() {
+        cursor = sizeof(log_magic);
+    }
+
+    // the next round, false at the end (a round cut off by a crash counts as the end)
+    bool next(LoggedRound& round) {
+        if (bytes - cursor < sizeof(LogRound)) {
+            return false;
+        }
+        memcpy(&round.header, data + cursor, sizeof(LogRound));
+        if (bytes - cursor - sizeof(LogRound) < round.header.eventCount) {
+            return false;
+        }
+        round.events = data + cursor + sizeof(LogRound);
+        cursor += sizeof(LogRound) + round.header.eventCount;
+        return true;
+    }
+};
+
+/*
+    Deal the round again from its seed and play its events. Every drawn card is
+    checked against the shuffle and the result is worked out again with the scoring
+    rules, so false means the log doesn't describe a game that could have happened
+    (or the rules changed since it was written).
+    hands gets both seats' final hands (the distinct cards, for a shoe with repeats).
+*/
+inline bool replay_round(const LoggedRound& round, RoundResult& result, HandMask hands[2]) {
+    const LogRound& h = round.header;
+    result = RoundResult();
+
+    if (h.decks > max_decks) {
+        return false;
+    }
+    Deck deck{Rng(h.seed), uint8(h.decks ? h.decks : 1)};
+    if (h.firstSeat > 1 || deck.remaining() < 2 * h.handSize + 1) {
+        return false;
+    }
+    CardCounts held[2];
+    held[0] = deck.deal_counts(h.handSize);
+    held[1] = deck.deal_counts(h.handSize);
+    Card discards[default_deck * max_decks];
+    int discardCount = 0;
+    discards[discardCount++] = deck.deal_card();
+
+    int seat = h.firstSeat;
+    int draws = 0;
+    int knocker = -1;
+    for (int i = 0; i < h.eventCount; ++i) {
+        uint8 e = round.events[i];
+        if (knocker >= 0) {
+            return false;   // nothing comes after a knock
+        }
+        LogEvent type = event_type(e);
+        if (type == LogEvent::DrawStock || type == LogEvent::DrawDiscard) {
+            if (draws++ > 0) {
+                seat = 1 - seat;
+            }
+            Card drawn;
+            if (type == LogEvent::DrawStock) {
+                if (deck.isEmpty()) {
+                    return false;
+                }
+                drawn = deck.deal_card();
+            } else {
+                if (discardCount == 0) {
+                    return false;
+                }
+                drawn = discards[--discardCount];
+            }
+            if (!(drawn == event_card(e))) {
+                return false;
+            }
+            held[seat].add(card_bit(drawn));
+        } else if (type == LogEvent::Discard) {
+            Card c = event_card(e);
+            if (!(held[seat].held() & card_bit(c)) || discardCount == default_deck * max_decks) {
+                return false;
+            }
+            held[seat].remove(card_bit(c));
+            discards[discardCount++] = c;
+        } else if (event_payload(e) == 1) {
+            knocker = seat;
+        }
+    }
+
+    if (knocker >= 0) {
+        // scored the way Round scores it, and without layoffs for older logs
+        int knockerDeadwood = min_deadwood(held[knocker]);
+        const CardCounts& defender = held[1 - knocker];
+        if ((h.rules & log_rule_layoffs) && knockerDeadwood > 0 && !held[knocker].repeated() &&
+            !defender.repeated()) {
+            LayoffResult layoff = resolve_layoffs(held[knocker].held(), defender.held());
+            result = knock_result(knocker, knockerDeadwood, layoff.deadwood, draws);
+            result.laidOff = layoff.laidOff;
+        } else {
+            result = knock_result(knocker, knockerDeadwood, min_deadwood(defender), draws);
+        }
+    } else {
+        result.type = RoundEnd::StockOut;
+        result.turns = draws;
+    }
+    hands[0] = held[0].held();
+    hands[1] = held[1].held();
+
+    return h.end == uint8(result.type) && h.knocker == result.knocker &&
+           h.winner == result.winner && h.points == result.points &&
+           h.knockerDeadwood == result.knockerDeadwood &&
+           h.opponentDeadwood == result.opponentDeadwood && h.turns == result.turns;
+}
+
+#endif /* game_log_h */
@@ -0,0 +1,738 @@
+#ifndef gin_rummy_h
+#define gin_rummy_h
+
+#include "deck.h"
+#include "card_utils.h"
+
+/*
+    The rules of a round without any terminal I/O, so a game can be played by code:
+    main() drives them through cin prompts, GameEngine drives them through
+    PlayerPolicy objects.
+*/
+
+constexpr int standard_hand_size = 10;
+constexpr int knock_limit = 10;     // most deadwood you may knock with
+constexpr int gin_bonus = 25;
+constexpr int undercut_bonus = 25;
+constexpr int game_target = 100;    // first to this many points wins the game
+constexpr int max_match_rounds = 1000; // stop a match of endless stock-outs between weak policies
+
+enum class RoundEnd : uint8 {
+    None,       // still being played
+    Knock,      // knocker had less deadwood
+    Gin,        // knocker had no deadwood
+    Undercut,   // defender had less deadwood than the knocker
+    StockOut    // stock ran out, nobody scores
+};
+
+// one word per RoundEnd, for protocols and logs
+constexpr const char* round_end_words[] = {"none", "knock", "gin", "undercut", "stockout"};
+
+/*
+    Rule variants. BasicRound and BasicGameEngine take one as a template parameter,
+    and every rule is a constant or a one-line function of it, so each variant is
+    compiled into its own round with no checks of which game is being played;
+    several can be played in one program. Round and GameEngine play StandardGin.
+*/
+struct StandardGin {
+    typedef AceLowRanks Ranks;
+    static constexpr const char* name = "standard";
+    static constexpr int handSize = standard_hand_size;
+    static constexpr int ginBonus = gin_bonus;
+    static constexpr int undercutBonus = undercut_bonus;
+    static constexpr int gameTarget = game_target;
+    // most deadwood a seat may knock with, given the card turned up at the deal
+    static int max_knock(Card) { return knock_limit; }
+    // what the points of the round are multiplied by
+    static int score_multiplier(Card) { return 1; }
+};
+
+// no knocking: a round only ends in gin or with the stock
+struct StraightGin : StandardGin {
+    static constexpr const char* name = "straight";
+    static int max_knock(Card) { return 0; }
+};
+
+// the upcard's value is the knock limit (an ace means gin only), and a spade upcard doubles the round
+struct OklahomaGin : StandardGin {
+    static constexpr const char* name = "oklahoma";
+    static constexpr int gameTarget = 150;
+    static int max_knock(Card upcard) { return upcard.rank == 1 ? 0 : card_value(upcard); }
+    static int score_multiplier(Card upcard) { return upcard.suit == 4 ? 2 : 1; } // suitstr's S
+};
+
+// the standard game with the ace above the king in runs (one pack only)
+struct AceHighGin : StandardGin {
+    typedef AceHighRanks Ranks;
+    static constexpr const char* name = "acehigh";
+};
+
+struct KnockResult {
+    RoundEnd type;
+    bool knockerWins;
+    int points;
+};
+
+// the scoring half of score_round, with Rules' bonuses
+template <class Rules>
+inline KnockResult score_knock(int knockerDeadwood, int opponentDeadwood) {
+    KnockResult result;
+    if (knockerDeadwood == 0) {
+        result = {RoundEnd::Gin, true, opponentDeadwood + Rules::ginBonus};
+    } else if (opponentDeadwood < knockerDeadwood) {
+        result = {RoundEnd::Undercut, false,
+                  (knockerDeadwood - opponentDeadwood) + Rules::undercutBonus};
+    } else {
+        result = {RoundEnd::Knock, true, opponentDeadwood - knockerDeadwood};
+    }
+    return result;
+}
+
+inline KnockResult score_knock(int knockerDeadwood, int opponentDeadwood) {
+    return score_knock<StandardGin>(knockerDeadwood, opponentDeadwood);
+}
+
+struct RoundResult {
+    RoundEnd type = RoundEnd::None;
+    int knocker = -1;           // seat that knocked, -1 if the stock ran out
+    int winner = -1;            // seat that scored, -1 if nobody did
+    int points = 0;
+    int knockerDeadwood = 0;
+    int opponentDeadwood = 0;   // after layoffs
+    HandMask laidOff = 0;       // the cards the opponent laid off on the knocker's melds
+    int turns = 0;
+};
+
+// a round that ended in a knock (or gin) by seat knocker, its points times multiplier
+template <class Rules>
+inline RoundResult knock_result(int knocker, int knockerDeadwood, int opponentDeadwood, int turns,
+                                int multiplier = 1) {
+    RoundResult result;
+    KnockResult score = score_knock<Rules>(knockerDeadwood, opponentDeadwood);
+    result.type = score.type;
+    result.knocker = knocker;
+    result.winner = score.knockerWins ? knocker : 1 - knocker;
+    result.points = score.points * multiplier;
+    result.knockerDeadwood = knockerDeadwood;
+    result.opponentDeadwood = opponentDeadwood;
+    result.turns = turns;
+    return result;
+}
+
+inline RoundResult knock_result(int knocker, int knockerDeadwood, int opponentDeadwood, int turns) {
+    return knock_result<StandardGin>(knocker, knockerDeadwood, opponentDeadwood, turns);
+}
+
+// adds a finished round to the metrics counters (nothing unless built with GIN_METRICS)
+inline void count_round(const RoundResult& result) {
+    metrics::count(metrics::Counter::Rounds);
+    if (result.knocker >= 0) {
+        metrics::count(metrics::Counter::Knocks);
+    }
+    if (result.type == RoundEnd::Gin) {
+        metrics::count(metrics::Counter::Gins);
+    } else if (result.type == RoundEnd::Undercut) {
+        metrics::count(metrics::Counter::Undercuts);
+    } else if (result.type == RoundEnd::StockOut) {
+        metrics::count(metrics::Counter::StockOuts);
+    }
+}
+
+/*
+    One round as a state machine: deal, then for each turn draw -> discard -> (knock
+    or pass). Each call checks it is legal in the current phase and returns false if
+    not, so a caller can feed it moves from anywhere (a policy, a prompt, a socket).
+
+    Mirrors take_turn: drawing from an empty stock takes the discard instead and the
+    other way round, and a hand with no deadwood after the discard goes gin on its own.
+
+    Rules is one of the variants above; hands are held in card_bit order and only
+    laid out in Rules::Ranks' order to be scored.
+*/
+template <class Rules>
+class BasicRound
+{
+public:
+    typedef typename Rules::Ranks Ranks;
+    enum Phase { Draw, Discard, Knock, Over };
+
+private:
+    Deck* deck = nullptr;
+    Phase currentPhase = Over;
+    int seatToMove = 0;
+    int turnCount = 0;
+    CardCounts hands[2];        // counts, since a shoe of several packs can repeat a card
+    HandMask pickups[2] = {0, 0};   // cards each seat took from the pile and still holds
+    Card discards[default_deck * max_decks];
+    uint16 discardCount = 0;
+    Card turnedUp = {0, 0};     // the first discard, some variants' rules depend on it
+    int deadwoodAfterDiscard = 0;
+    RoundResult outcome;
+    DeadwoodLookup* cache = nullptr;
+
+    int deadwood_of(int seat) const {
+        if constexpr (!Ranks::shoes) {
+            return min_deadwood<Ranks>(Ranks::layout(hands[seat].held()));
+        }
+        if (cache && !hands[seat].repeated()) {
+            return cache->min_deadwood(hands[seat].held());
+        }
+        return min_deadwood(hands[seat]);
+    }
+
+    void next_turn() {
+        seatToMove = 1 - seatToMove;
+        // the round is a draw once nobody can draw from the stock any more
+        if (deck->isEmpty()) {
+            outcome.type = RoundEnd::StockOut;
+            outcome.turns = turnCount;
+            currentPhase = Over;
+        } else {
+            ++turnCount;
+            currentPhase = Draw;
+        }
+    }
+
+    /*
+        The defender lays off on the knocker's melds unless the knocker went gin.
+        Layoffs are worked out on distinct cards, so with a shoe they only happen
+        when neither hand holds a card twice.
+    */
+    void finish_knock() {
+        metrics::PhaseTimer timer(metrics::Phase::ScoreRound);
+        int defender = 1 - seatToMove;
+        int multiplier = Rules::score_multiplier(turnedUp);
+        if (deadwoodAfterDiscard > 0 && !hands[0].repeated() && !hands[1].repeated()) {
+            LayoffResult layoff = resolve_layoffs<Ranks>(Ranks::layout(hands[seatToMove].held()),
+                                                         Ranks::layout(hands[defender].held()));
+            outcome = knock_result<Rules>(seatToMove, deadwoodAfterDiscard, layoff.deadwood,
+                                          turnCount, multiplier);
+            outcome.laidOff = Ranks::cards(layoff.laidOff);
+        } else {
+            outcome = knock_result<Rules>(seatToMove, deadwoodAfterDiscard, deadwood_of(defender),
+                                          turnCount, multiplier);
+        }
+        currentPhase = Over;
+    }
+
+public:
+    // score one-pack hands through a cache of solved hands (deadwood_cache.h), nullptr for none
+    void use_cache(DeadwoodLookup* c) {
+        cache = c;
+    }
+
+    /*
+        deal handSize cards to each seat (seat 0 first) and turn up the first discard;
+        false if the deck is too small, or is a shoe and Rules' rank order takes one pack
+    */
+    bool deal(Deck& d, int handSize, int firstSeat) {
+        metrics::PhaseTimer timer(metrics::Phase::Deal);
+        deck = &d;
+        outcome = RoundResult();
+        discardCount = 0;
+        pickups[0] = pickups[1] = 0;
+        turnCount = 1;
+        seatToMove = firstSeat;
+        currentPhase = Over;
+
+        if (deck->remaining() < 2 * handSize + 1 || (!Ranks::shoes && deck->packs() > 1)) {
+            return false;
+        }
+        hands[0] = deck->deal_counts(handSize);
+        hands[1] = deck->deal_counts(handSize);
+        turnedUp = deck->deal_card();
+        discards[discardCount++] = turnedUp;
+        currentPhase = Draw;
+        return true;
+    }
+
+    /*
+        Start from a position part way through a round instead of a deal, eg. one a
+        search has guessed. d must already hold the stock (Deck::load), pile is the
+        discard pile from the bottom up (its first card the upcard), and phase is
+        where seat toMove stands.
+    */
+    void resume(Deck& d, const HandMask hand[2], const Card* pile, uint16 pileCount,
+                const HandMask pickedUp[2], int toMove, int turn, Phase phase) {
+        deck = &d;
+        outcome = RoundResult();
+        for (int seat = 0; seat < 2; ++seat) {
+            hands[seat] = CardCounts(hand[seat]);
+            pickups[seat] = pickedUp[seat];
+        }
+        for (discardCount = 0; discardCount < pileCount; ++discardCount) {
+            discards[discardCount] = pile[discardCount];
+        }
+        turnedUp = pileCount > 0 ? pile[0] : Card{0, 0};
+        seatToMove = toMove;
+        turnCount = turn;
+        currentPhase = phase;
+        if (phase == Knock) {
+            deadwoodAfterDiscard = deadwood_of(toMove);
+        }
+    }
+
+    Phase phase() const { return currentPhase; }
+    int to_move() const { return seatToMove; }
+    int turns() const { return turnCount; }
+    // the distinct cards a seat holds; counts() also says how many of each
+    HandMask hand(int seat) const { return hands[seat].held(); }
+    const CardCounts& counts(int seat) const { return hands[seat]; }
+    bool has_discard() const { return discardCount > 0; }
+    Card top_discard() const { return discards[discardCount - 1]; }
+    // the whole pile, bottom first
+    const Card* discard_pile() const { return discards; }
+    uint16 discard_count() const { return discardCount; }
+    // what the other seat has seen this seat take from the pile (and not thrown back)
+    HandMask picked_up(int seat) const { return pickups[seat]; }
+    int cards_held(int seat) const { return card_count(hands[seat]); }
+    uint16 stock_remaining() const { return deck->remaining(); }
+    // deadwood of the mover's hand after their discard, valid in the Knock phase
+    int deadwood() const { return deadwoodAfterDiscard; }
+    // the card turned up at the deal, and the most deadwood a knock may have because of it
+    Card upcard() const { return turnedUp; }
+    int knock_limit() const { return Rules::max_knock(turnedUp); }
+    const RoundResult& result() const { return outcome; }
+
+    // returns the card drawn
+    bool draw(bool fromDiscard, Card& drawn) {
+        if (currentPhase != Draw) {
+            return false;
+        }
+        if (fromDiscard ? discardCount == 0 : deck->isEmpty()) {
+            fromDiscard = !fromDiscard;
+        }
+        drawn = fromDiscard ? discards[--discardCount] : deck->deal_card();
+        hands[seatToMove].add(card_bit(drawn));
+        if (fromDiscard) {
+            pickups[seatToMove] |= card_bit(drawn);
+        }
+        currentPhase = Discard;
+        return true;
+    }
+
+    bool discard(Card c) {
+        HandMask bit = card_bit(c);
+        if (currentPhase != Discard || !(hands[seatToMove].held() & bit)) {
+            return false;
+        }
+        hands[seatToMove].remove(bit);
+        pickups[seatToMove] &= ~bit;
+        discards[discardCount++] = c;
+
+        deadwoodAfterDiscard = deadwood_of(seatToMove);
+        if (deadwoodAfterDiscard == 0) {
+            finish_knock();
+        } else if (deadwoodAfterDiscard <= Rules::max_knock(turnedUp)) {
+            currentPhase = Knock;
+        } else {
+            next_turn();
+        }
+        return true;
+    }
+
+    // answer the knock offer
+    bool knock(bool yes) {
+        if (currentPhase != Knock) {
+            return false;
+        }
+        if (yes) {
+            finish_knock();
+        } else {
+            next_turn();
+        }
+        return true;
+    }
+};
+
+typedef BasicRound<StandardGin> Round;
+
+// what a seat can see when it has to make a decision
+struct TurnView {
+    int seat;
+    int turn;
+    HandMask hand;
+    CardCounts counts;          // the hand with repeats, only differs from hand in a multi-pack shoe
+    bool hasDiscard;
+    Card topDiscard;
+    uint16 stockRemaining;
+    // everything else that is public: the pile bottom first, the cards the opponent
+    // is known to hold because it took them from the pile, and how many it holds
+    const Card* discards;
+    uint16 discardCount;
+    HandMask opponentPickups;
+    int opponentCards;
+};
+
+template <class Rules>
+inline TurnView turn_view(const BasicRound<Rules>& round) {
+    TurnView v;
+    v.seat = round.to_move();
+    v.turn = round.turns();
+    v.hand = round.hand(v.seat);
+    v.counts = round.counts(v.seat);
+    v.hasDiscard = round.has_discard();
+    v.topDiscard = v.hasDiscard ? round.top_discard() : Card{0, 0};
+    v.stockRemaining = round.stock_remaining();
+    v.discards = round.discard_pile();
+    v.discardCount = round.discard_count();
+    v.opponentPickups = round.picked_up(1 - v.seat);
+    v.opponentCards = round.cards_held(1 - v.seat);
+    return v;
+}
+
+/*
+    A seat at the table. The engine asks each question only when it is legal:
+    draw_from_discard before the draw, choose_discard with the drawn card in hand,
+    knock only when deadwood is at or under the round's knock limit.
+*/
+class PlayerPolicy
+{
+public:
+    virtual ~PlayerPolicy() {}
+    virtual bool draw_from_discard(const TurnView& view) = 0;
+    virtual Card choose_discard(const TurnView& view) = 0;
+    virtual bool knock(const TurnView& view, int deadwood) = 0;
+    // policies with randomness of their own reseed here so a replayed match matches
+    virtual void reseed(uint64) {}
+};
+
+// sees every move of a round as it is played, eg. to log it (see game_log.h)
+class RoundObserver
+{
+public:
+    virtual ~RoundObserver() {}
+    virtual void begin(uint64 /*seed*/, int /*handSize*/, int /*firstSeat*/, int /*decks*/) {}
+    virtual void draw(bool /*fromDiscard*/, Card /*drawn*/) {}
+    virtual void discard(Card /*c*/) {}
+    // yes is also true for gin, where the round ends without asking
+    virtual void knock(bool /*yes*/) {}
+    virtual void end(const RoundResult& /*result*/) {}
+};
+
+// takes the discard only when it lowers deadwood, throws the card that leaves the least, always knocks
+// (plays on the counts when the hand repeats a card, so it also knows what to do with a shoe)
+class GreedyPolicy : public PlayerPolicy
+{
+private:
+    DeadwoodLookup* cache;
+
+public:
+    // cache, if given, scores the one-pack hands whose melds overlap
+    explicit GreedyPolicy(DeadwoodLookup* cache = nullptr) : cache(cache) {}
+
+    bool draw_from_discard(const TurnView& view) override {
+        if (!view.hasDiscard) {
+            return false;
+        }
+        int withDiscard;
+        HandMask top = card_bit(view.topDiscard);
+        if (view.counts.repeated() || (view.counts.held() & top)) {
+            CardCounts with = view.counts;
+            with.add(top);
+            best_discard(with, withDiscard);
+            return withDiscard < min_deadwood(view.counts);
+        }
+        best_discard(view.hand | top, withDiscard, cache);
+        return withDiscard < (cache ? cache->min_deadwood(view.hand) : min_deadwood(view.hand));
+    }
+
+    Card choose_discard(const TurnView& view) override {
+        int deadwood;
+        if (view.counts.repeated()) {
+            return best_discard(view.counts, deadwood);
+        }
+        return best_discard(view.hand, deadwood, cache);
+    }
+
+    bool knock(const TurnView&, int) override {
+        return true;
+    }
+};
+
+/*
+    The computer opponent. Scores all 11 discards at once with evaluate_discards and
+    keeps the hand with the least deadwood, then the most cards one draw from a meld,
+    then throws the higher card. Takes the discard pile only when that leaves less
+    deadwood than the hand has now (or the same deadwood with better melding chances).
+    Like GreedyPolicy it plays on the counts when the hand repeats a card.
+*/
+class BotPolicy : public PlayerPolicy
+{
+private:
+    DeadwoodLookup* cache;
+
+    static bool better(const DiscardChoice& a, const DiscardChoice& b) {
+        if (a.deadwood != b.deadwood) return a.deadwood < b.deadwood;
+        if (a.potential != b.potential) return a.potential > b.potential;
+        return card_value(a.card) > card_value(b.card);
+    }
+
+    // best choice, never throwing back the card in keep (pass 0 to allow any)
+    DiscardChoice pick(const CardCounts& hand, HandMask keep) const {
+        DiscardChoice choices[default_deck];
+        int count = evaluate_discards(hand, choices, cache);
+        int best = -1;
+        for (int i = 0; i < count; ++i) {
+            if (card_bit(choices[i].card) & keep) {
+                continue;
+            }
+            if (best < 0 || better(choices[i], choices[best])) {
+                best = i;
+            }
+        }
+        return choices[best];
+    }
+
+public:
+    explicit BotPolicy(DeadwoodLookup* cache = nullptr) : cache(cache) {}
+
+    bool draw_from_discard(const TurnView& view) override {
+        if (!view.hasDiscard) {
+            return false;
+        }
+        HandMask top = card_bit(view.topDiscard);
+        CardCounts with = view.counts;
+        with.add(top);
+        DiscardChoice withTop = pick(with, top);
+        int now;
+        if (view.counts.repeated()) {
+            now = min_deadwood(view.counts);
+        } else {
+            now = cache ? cache->min_deadwood(view.hand) : min_deadwood(view.hand);
+        }
+        return withTop.deadwood < now ||
+               (withTop.deadwood == now && withTop.potential > meld_potential(view.hand));
+    }
+
+    Card choose_discard(const TurnView& view) override {
+        return pick(view.counts, 0).card;
+    }
+
+    bool knock(const TurnView&, int) override {
+        return true;
+    }
+};
+
+// baseline: every choice is a coin flip
+class RandomPolicy : public PlayerPolicy
+{
+private:
+    Rng rng;
+
+public:
+    explicit RandomPolicy(uint64 seed = 0) : rng(seed) {}
+
+    bool draw_from_discard(const TurnView&) override {
+        return rng() % 2 == 0;
+    }
+
+    Card choose_discard(const TurnView& view) override {
+        HandMask rest = view.hand;
+        for (int skip = rng.below(card_count(rest)); skip > 0; --skip) {
+            rest &= rest - 1;
+        }
+        return bit_card(__builtin_ctzll(rest));
+    }
+
+    bool knock(const TurnView&, int) override {
+        return rng() % 2 == 0;
+    }
+
+    void reseed(uint64 seed) override {
+        rng.reseed(seed);
+    }
+};
+
+struct MatchResult {
+    int scores[2] = {0, 0};
+    int winner = -1;
+    int rounds = 0;
+    // per seat: rounds it knocked (gins included), went gin, undercut the other seat
+    int knocks[2] = {0, 0};
+    int gins[2] = {0, 0};
+    int undercuts[2] = {0, 0};
+    int stockOuts = 0;
+};
+
+/*
+    Plays whole rounds or matches between two policies with no I/O.
+    One Deck is kept for the engine's lifetime and reshuffled every round, so an engine
+    is cheap to reuse but must not be shared between threads. Rules is the variant
+    played; the policies themselves play the same way under any of them.
+*/
+template <class Rules>
+class BasicGameEngine
+{
+private:
+    typedef BasicRound<Rules> RulesRound;
+
+    Deck deck;
+    RulesRound round;
+    int handSize;
+    RoundObserver* observer = nullptr;
+
+    TurnView view() const {
+        return turn_view(round);
+    }
+
+    // the dealt round played to its end, reported to watcher if there is one
+    RoundResult play_out(PlayerPolicy* seats[2], RoundObserver* watcher) {
+        Card drawn;
+        while (round.phase() != RulesRound::Over) {
+            PlayerPolicy& player = *seats[round.to_move()];
+            switch (round.phase()) {
+                case RulesRound::Draw: {
+                    uint16 stockBefore = round.stock_remaining();
+                    bool fromDiscard;
+                    {
+                        metrics::PhaseTimer timer(metrics::Phase::DrawDecision);
+                        fromDiscard = player.draw_from_discard(view());
+                    }
+                    round.draw(fromDiscard, drawn);
+                    if (watcher) {
+                        // draw() falls back to the other pile when the chosen one is empty
+                        watcher->draw(round.stock_remaining() == stockBefore, drawn);
+                    }
+                    break;
+                }
+                case RulesRound::Discard: {
+                    Card pick;
+                    {
+                        metrics::PhaseTimer timer(metrics::Phase::DiscardDecision);
+                        pick = player.choose_discard(view());
+                    }
+                    if (!round.discard(pick)) {
+                        // a policy that names a card it doesn't hold loses that choice
+                        int deadwood;
+                        pick = best_discard(round.hand(round.to_move()), deadwood);
+                        round.discard(pick);
+                    }
+                    if (watcher) {
+                        watcher->discard(pick);
+                        if (round.result().knocker >= 0) {
+                            watcher->knock(true);  // gin
+                        }
+                    }
+                    break;
+                }
+                case RulesRound::Knock: {
+                    bool yes = player.knock(view(), round.deadwood());
+                    round.knock(yes);
+                    if (watcher) {
+                        watcher->knock(yes);
+                    }
+                    break;
+                }
+                case RulesRound::Over:
+                    break;
+            }
+        }
+
+        if (watcher) {
+            watcher->end(round.result());
+        }
+        count_round(round.result());
+        return round.result();
+    }
+
+public:
+    // decks > 1 deals from a shoe of that many packs, if Rules' rank order allows one
+    explicit BasicGameEngine(int cardsPerHand = Rules::handSize, uint8 decks = 1)
+        : deck(decks), handSize(cardsPerHand) {}
+
+    // fixes every shuffle from here on, the same seed replays the same deals
+    void reseed(uint64 seed) {
+        deck.seed(seed);
+    }
+
+    // nullptr to stop watching
+    void watch(RoundObserver* o) {
+        observer = o;
+    }
+
+    // see BasicRound::use_cache; the policies take their own
+    void use_cache(DeadwoodLookup* cache) {
+        round.use_cache(cache);
+    }
+
+    RoundResult play_round(PlayerPolicy& seat0, PlayerPolicy& seat1, int firstSeat = 0) {
+        PlayerPolicy* seats[2] = {&seat0, &seat1};
+
+        // every round gets a seed of its own, so a logged round can be dealt again alone
+        uint64 roundSeed = deck.generator().next();
+        deck.seed(roundSeed);
+        deck.new_deck();
+        if (!round.deal(deck, handSize, firstSeat)) {
+            return round.result();
+        }
+        if (observer) {
+            observer->begin(roundSeed, handSize, firstSeat, deck.packs());
+        }
+
+        return play_out(seats, observer);
+    }
+
+    /*
+        A round in which seat 0 is dealt exactly hand (handSize cards, one pack only)
+        and everything else comes from the shuffle, for measuring what a starting hand
+        is worth. It isn't reported to the observer: a log couldn't deal it again from
+        its seed.
+    */
+    RoundResult play_round_from(HandMask hand, PlayerPolicy& seat0, PlayerPolicy& seat1,
+                                int firstSeat = 0) {
+        PlayerPolicy* seats[2] = {&seat0, &seat1};
+        deck.seed(deck.generator().next());
+        deck.new_deck();
+        Card rest[default_deck];
+        uint16 restCount = 0;
+        for (uint16 i = 0; i < deck.remaining(); ++i) {
+            if (!(card_bit(deck.get_card(i)) & hand)) {
+                rest[restCount++] = deck.get_card(i);
+            }
+        }
+        deck.load(rest, restCount);
+        const HandMask hands[2] = {hand, deck.deal_mask(uint8(handSize))};
+        const HandMask noPickups[2] = {0, 0};
+        Card turnedUp = deck.deal_card();
+        round.resume(deck, hands, &turnedUp, 1, noPickups, firstSeat, 1, RulesRound::Draw);
+        return play_out(seats, nullptr);
+    }
+
+    // the round last played, as it ended
+    const RulesRound& last_round() const {
+        return round;
+    }
+
+    // rounds alternate who goes first, until someone reaches target points
+    MatchResult play_match(PlayerPolicy& seat0, PlayerPolicy& seat1, int target = Rules::gameTarget) {
+        MatchResult match;
+        while (match.scores[0] < target && match.scores[1] < target &&
+               match.rounds < max_match_rounds) {
+            RoundResult result = play_round(seat0, seat1, match.rounds % 2);
+            ++match.rounds;
+            if (result.winner >= 0) {
+                match.scores[result.winner] += result.points;
+            }
+            if (result.knocker >= 0) {
+                ++match.knocks[result.knocker];
+            }
+            if (result.type == RoundEnd::Gin) {
+                ++match.gins[result.winner];
+            } else if (result.type == RoundEnd::Undercut) {
+                ++match.undercuts[result.winner];
+            } else if (result.type == RoundEnd::StockOut) {
+                ++match.stockOuts;
+            }
+        }
+        // a match cut off at max_match_rounds goes to the leader, -1 if level
+        if (match.scores[0] != match.scores[1]) {
+            match.winner = match.scores[0] > match.scores[1] ? 0 : 1;
+        }
+        return match;
+    }
+};
+
+typedef BasicGameEngine<StandardGin> GameEngine;
+
+#endif /* gin_rummy_h */
@@ -0,0 +1,272 @@
+#ifndef hand_values_h
+#define hand_values_h
+
+#include "deck.h"
+#include "card_utils.h"
+#include "gin_rummy.h"
+#include "deadwood_cache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+    What a starting hand is worth, worked out once offline for every starting hand
+    of a small size and looked up at run time.
+
+    Suits only relabel a hand (see canonical_hand), so only canonical hands are
+    measured: 3-card hands come down from 22100 to 1755 of them, 5-card ones from
+    2.6 million to 134459. Each is played samples times by two bots from
+    seat 0 with the rest of the deal shuffled, half the rounds with each seat first.
+    handdb.cpp does that on every core and writes the file.
+
+    file:    a 32-byte HandValueHeader, then 2^log2Buckets + 1 uint32 bucket starts
+             (padded to 8 bytes), then the HandValue entries
+    entries: sorted by bucket, then by hand; a hand's bucket is the top bits of its
+             canonical mask times a constant, the same hash as DeadwoodCache
+
+    There are about as many buckets as entries, so a lookup reads one bucket start
+    pair and one or two entries whatever the table size. The reader maps the file
+    and reads it in place. POSIX only (mmap).
+*/
+
+constexpr char hand_values_magic[8] = {'G', 'I', 'N', 'H', 'A', 'N', 'D', 1};
+
+// past this many cards the canonical hands are too many to play each one through
+constexpr int max_table_hand = 6;
+
+struct HandValueHeader {
+    char magic[8];
+    uint8 handSize;
+    uint8 log2Buckets;
+    uint16 reserved;
+    uint32 entryCount;
+    uint32 samples;         // rounds played per hand
+    uint32 reserved2;
+    uint64 seed;
+};
+static_assert(sizeof(HandValueHeader) == 32, "the header is written as it sits in memory");
+
+// one canonical hand, from the view of the seat dealt it
+struct HandValue {
+    HandMask hand;          // canonical
+    float points;           // mean points per round: scored, less what the other seat scored
+    uint16 winRate;         // rounds it scored in, out of 65535
+    uint16 meldRate;        // rounds it ended holding at least one meld, out of 65535
+
+    double win_rate() const { return winRate / 65535.0; }
+    double meld_rate() const { return meldRate / 65535.0; }
+};
+static_assert(sizeof(HandValue) == 16, "entries are written as they sit in memory");
+
+inline uint32 hand_value_bucket(HandMask canonical, int log2Buckets) {
+    return uint32((canonical * 0x9E3779B97F4A7C15ULL) >> (64 - log2Buckets));
+}
+
+// the 52 cards' bits in order, so a combination of indexes can be turned into a mask
+inline HandMask card_of_index(int i) {
+    return HandMask(1) << ((i / rankcount) * lanewidth + i % rankcount);
+}
+
+// every canonical hand of n one-pack cards, smallest mask first
+inline std::vector<HandMask> canonical_starting_hands(int n) {
+    std::vector<HandMask> hands;
+    if (n < 1 || n > default_deck) {
+        return hands;
+    }
+    // the n-card combinations of 52 indexes in order, as index bitmasks (Gosper's hack)
+    const uint64 end = uint64(1) << default_deck;
+    for (uint64 combo = (uint64(1) << n) - 1; combo < end;) {
+        HandMask hand = 0;
+        for (uint64 rest = combo; rest; rest &= rest - 1) {
+            hand |= card_of_index(__builtin_ctzll(rest));
+        }
+        if (canonical_hand(hand).mask == hand) {
+            hands.push_back(hand);
+        }
+        uint64 low = combo & -combo;
+        uint64 ripple = combo + low;
+        combo = ripple | (((combo ^ ripple) >> 2) / low);
+    }
+    std::sort(hands.begin(), hands.end());
+    return hands;
+}
+
+/*
+    Plays hand from seat 0 samples times, the engine reseeded from seed and the hand
+    so the answer doesn't depend on which thread or in what order it was measured.
+    engine has to deal hands of hand's size from one pack.
+*/
+inline HandValue measure_hand(GameEngine& engine, PlayerPolicy& seat0, PlayerPolicy& seat1,
+                              HandMask hand, int samples, uint64 seed) {
+    engine.reseed(mix_seed(seed ^ hand));
+    int64_t points = 0;
+    int wins = 0, melds = 0;
+    for (int i = 0; i < samples; ++i) {
+        RoundResult r = engine.play_round_from(hand, seat0, seat1, i % 2);
+        if (r.winner == 0) {
+            points += r.points;
+            ++wins;
+        } else if (r.winner == 1) {
+            points -= r.points;
+        }
+        HandMask held = engine.last_round().hand(0);
+        melds += (set_cards(held) | run_cards(held)) != 0;
+    }
+    HandValue value;
+    value.hand = hand;
+    value.points = samples ? float(double(points) / samples) : 0;
+    value.winRate = samples ? uint16((uint64(wins) * 65535 + samples / 2) / samples) : 0;
+    value.meldRate = samples ? uint16((uint64(melds) * 65535 + samples / 2) / samples) : 0;
+    return value;
+}
+
+// entries in any order; false if the file can't be written
+inline bool write_hand_values(const std::string& path, int handSize, int samples, uint64 seed,
+                              std::vector<HandValue> entries) {
+    HandValueHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, hand_values_magic, sizeof(header.magic));
+    header.handSize = uint8(handSize);
+    header.log2Buckets = 1;
+    while ((size_t(1) << header.log2Buckets) < entries.size()) {
+        ++header.log2Buckets;
+    }
+    header.entryCount = uint32(entries.size());
+    header.samples = uint32(samples);
+    header.seed = seed;
+
+    int log2Buckets = header.log2Buckets;
+    std::sort(entries.begin(), entries.end(), [&](const HandValue& a, const HandValue& b) {
+        uint32 bucketA = hand_value_bucket(a.hand, log2Buckets);
+        uint32 bucketB = hand_value_bucket(b.hand, log2Buckets);
+        return bucketA != bucketB ? bucketA < bucketB : a.hand < b.hand;
+    });
+    size_t buckets = size_t(1) << log2Buckets;
+    std::vector<uint32> starts(buckets + 1 + (buckets % 2 == 0), 0);
+    for (const HandValue& e : entries) {
+        ++starts[hand_value_bucket(e.hand, log2Buckets) + 1];
+    }
+    for (size_t b = 1; b <= buckets; ++b) {
+        starts[b] += starts[b - 1];
+    }
+    if (starts.size() > buckets + 1) {
+        starts.back() = 0;  // padding
+    }
+
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(starts.data(), sizeof(uint32), starts.size(), out) == starts.size() &&
+              fwrite(entries.data(), sizeof(HandValue), entries.size(), out) == entries.size();
+    return fclose(out) == 0 && ok;
+}
+
+class HandValueTable
+{
+private:
+    const uint8* data = nullptr;
+    size_t bytes = 0;
+    HandValueHeader header;
+    const uint32* starts = nullptr;
+    const HandValue* entries = nullptr;
+
+public:
+    HandValueTable() {}
+    HandValueTable(const HandValueTable&) = delete;
+    HandValueTable& operator=(const HandValueTable&) = delete;
+    ~HandValueTable() {
+        close();
+    }
+
+    // false if the file is missing, isn't a table, is cut short or its buckets don't add up
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(HandValueHeader)) {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);    // the mapping keeps the file alive
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        data = static_cast<const uint8*>(mapped);
+        bytes = size_t(info.st_size);
+        madvise(mapped, bytes, MADV_RANDOM);
+
+        memcpy(&header, data, sizeof(header));
+        // the shift below is only defined once log2Buckets is known to be in range
+        if (memcmp(header.magic, hand_values_magic, sizeof(header.magic)) != 0 ||
+            header.log2Buckets < 1 || header.log2Buckets > 32 ||
+            header.handSize < 1 || header.handSize > max_table_hand) {
+            close();
+            return false;
+        }
+        size_t buckets = size_t(1) << header.log2Buckets;
+        size_t startWords = buckets + 1 + (buckets % 2 == 0);
+        size_t entriesAt = sizeof(header) + startWords * sizeof(uint32);
+        if (bytes != entriesAt + size_t(header.entryCount) * sizeof(HandValue)) {
+            close();
+            return false;
+        }
+        starts = reinterpret_cast<const uint32*>(data + sizeof(header));
+        entries = reinterpret_cast<const HandValue*>(data + entriesAt);
+        // find() reads entries starts[b] to starts[b + 1], so every range has to be inside the file
+        for (size_t b = 0; b < buckets; ++b) {
+            if (starts[b] > starts[b + 1]) {
+                close();
+                return false;
+            }
+        }
+        if (starts[buckets] != header.entryCount) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (data) {
+            munmap(const_cast<uint8*>(data), bytes);
+            data = nullptr;
+            bytes = 0;
+            starts = nullptr;
+            entries = nullptr;
+        }
+    }
+
+    bool is_open() const { return data != nullptr; }
+    int hand_size() const { return data ? header.handSize : 0; }
+    uint32 size() const { return data ? header.entryCount : 0; }
+    uint32 samples() const { return header.samples; }
+
+    // the value of hand, in any suits; nullptr if it isn't in the table (eg. the wrong size)
+    const HandValue* find(HandMask hand) const {
+        if (!data) {
+            return nullptr;
+        }
+        HandMask canonical = canonical_hand(hand).mask;
+        uint32 bucket = hand_value_bucket(canonical, header.log2Buckets);
+        for (uint32 i = starts[bucket]; i < starts[bucket + 1]; ++i) {
+            if (entries[i].hand == canonical) {
+                return &entries[i];
+            }
+        }
+        return nullptr;
+    }
+};
+
+#endif /* hand_values_h */
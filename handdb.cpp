@@ -0,0 +1,147 @@
+#include <iostream>
+#include "deck.h"
+#include "gin_rummy.h"
+#include "game_io.h"
+#include "hand_values.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+    Builds a starting-hand table (hand_values.h) for one hand size. Usage:
+        ./handdb --hand 3 --out hands3.db                 every canonical 3-card hand, 2000 rounds each
+        ./handdb --hand 4 --samples 500 --threads 8 --out hands4.db
+        ./handdb --show hands3.db                         the best and worst hands in a table
+
+    Every hand is played with seed mix_seed(seed ^ hand) whichever thread measures
+    it, so the same seed writes the same file.
+*/
+
+const int DEFAULT_SAMPLES = 2000;   // rounds per hand
+const uint32 CLAIM = 16;            // hands a worker takes at a time
+const int SHOW_HANDS = 10;          // --show prints this many at each end
+
+void worker(const vector<HandMask>& hands, atomic<uint32>& next, int handSize, int samples,
+            uint64 seed, vector<HandValue>& values) {
+    GameEngine engine(handSize);
+    BotPolicy seat0, seat1;
+    for (;;) {
+        uint32 begin = next.fetch_add(CLAIM);
+        if (begin >= hands.size()) {
+            return;
+        }
+        uint32 end = min(uint32(hands.size()), begin + CLAIM);
+        for (uint32 i = begin; i < end; ++i) {
+            values[i] = measure_hand(engine, seat0, seat1, hands[i], samples, seed);
+        }
+    }
+}
+
+void print_value(const HandValue& v) {
+    printf("  %-20s %+7.2f points  %5.1f%% won  %5.1f%% melded\n", mask_text(v.hand).c_str(),
+           v.points, 100 * v.win_rate(), 100 * v.meld_rate());
+}
+
+// every entry of a table, read back through the mapping, best and worst first
+int show_table(const string& path) {
+    HandValueTable table;
+    if (!table.open(path)) {
+        cout << "Can't read a hand table from " << path << '\n';
+        return 1;
+    }
+    vector<HandValue> all;
+    for (HandMask hand : canonical_starting_hands(table.hand_size())) {
+        const HandValue* v = table.find(hand);
+        if (!v) {
+            cout << "Hand " << mask_text(hand) << " is missing from " << path << '\n';
+            return 1;
+        }
+        all.push_back(*v);
+    }
+    sort(all.begin(), all.end(), [](const HandValue& a, const HandValue& b) {
+        return a.points > b.points;
+    });
+    cout << table.size() << " canonical " << table.hand_size() << "-card hands, "
+         << table.samples() << " rounds each\nbest:\n";
+    for (size_t i = 0; i < all.size() && i < SHOW_HANDS; ++i) {
+        print_value(all[i]);
+    }
+    cout << "worst:\n";
+    for (size_t i = all.size() > SHOW_HANDS ? all.size() - SHOW_HANDS : 0; i < all.size(); ++i) {
+        print_value(all[i]);
+    }
+    return 0;
+}
+
+int main(int argc, const char * argv[]) {
+    int handSize = 3;
+    int samples = DEFAULT_SAMPLES;
+    uint64 seed = 1;
+    unsigned threads = thread::hardware_concurrency();
+    string outPath, showPath;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--hand" && hasValue) {
+            handSize = atoi(argv[++i]);
+        } else if (arg == "--samples" && hasValue) {
+            samples = atoi(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--threads" && hasValue) {
+            threads = unsigned(atoi(argv[++i]));
+        } else if (arg == "--out" && hasValue) {
+            outPath = argv[++i];
+        } else if (arg == "--show" && hasValue) {
+            showPath = argv[++i];
+        } else {
+            cout << "usage: handdb --out file [--hand N] [--samples N] [--seed S] [--threads T]\n"
+                    "       handdb --show file\n";
+            return 1;
+        }
+    }
+    if (!showPath.empty()) {
+        return show_table(showPath);
+    }
+    if (outPath.empty()) {
+        cout << "Name the table to write with --out\n";
+        return 1;
+    }
+    if (handSize < 1 || handSize > max_table_hand) {
+        cout << "Hand size must be 1 to " << max_table_hand << "\n";
+        return 1;
+    }
+    if (samples < 1) {
+        cout << "Samples must be at least 1\n";
+        return 1;
+    }
+    if (threads == 0) threads = 1;
+
+    auto start = chrono::steady_clock::now();
+    vector<HandMask> hands = canonical_starting_hands(handSize);
+    vector<HandValue> values(hands.size());
+    atomic<uint32> next{0};
+    vector<thread> pool;
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back(worker, cref(hands), ref(next), handSize, samples, seed, ref(values));
+    }
+    for (thread& t : pool) {
+        t.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (!write_hand_values(outPath, handSize, samples, seed, values)) {
+        cout << "Can't write " << outPath << '\n';
+        return 1;
+    }
+    cout << hands.size() << " canonical " << handSize << "-card hands, " << samples
+         << " rounds each, in " << seconds << " s ("
+         << double(hands.size()) * samples / seconds << " rounds/s) -> " << outPath << '\n';
+    return 0;
+}
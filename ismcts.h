@@ -0,0 +1,436 @@
+#ifndef ismcts_h
+#define ismcts_h
+
+#include "deck.h"
+#include "card_utils.h"
+#include "gin_rummy.h"
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/*
+    Computer player built on information-set Monte Carlo tree search (single observer).
+
+    The seat to move knows its own hand, the discard pile, and the cards the opponent
+    took from the pile, but not the rest of the opponent's hand or the stock order.
+    Each iteration deals those unknown cards out at random in a way that fits what is
+    known (a determinization), walks the tree choosing with UCB among the moves that
+    are legal in that deal, adds one node, plays the round out with GreedyPolicy on
+    both seats and backs the points up the path. A child is only legal in some deals
+    (the opponent can only throw cards it holds), so its UCB term counts the times it
+    was available, not the times its parent was visited.
+
+    Root parallel: each thread grows its own tree until the move's time is up, the root
+    visit counts are added together and the most visited move is played. Nodes come from
+    a fixed pool per thread, allocated once and reused every move.
+
+    Searches one-pack games only; for a hand from a shoe it plays like GreedyPolicy.
+*/
+
+// a move in the tree: the two draws, the knock answer, or discard + the card's bit index
+enum SearchAction : uint8 {
+    ActDrawStock,
+    ActDrawDiscard,
+    ActPlayOn,
+    ActKnock,
+    ActDiscard      // ActDiscard + card bit (0-63)
+};
+constexpr int search_actions = ActDiscard + 64;
+
+struct ActionSet {
+    uint64 bits[2] = {0, 0};
+
+    bool has(int a) const { return (bits[a >> 6] >> (a & 63)) & 1; }
+    void add(int a) { bits[a >> 6] |= uint64(1) << (a & 63); }
+    int count() const { return __builtin_popcountll(bits[0]) + __builtin_popcountll(bits[1]); }
+
+    // the n-th action in the set (0-based)
+    int nth(int n) const {
+        for (int w = 0; w < 2; ++w) {
+            int inWord = __builtin_popcountll(bits[w]);
+            if (n >= inWord) {
+                n -= inWord;
+                continue;
+            }
+            uint64 rest = bits[w];
+            for (; n > 0; --n) {
+                rest &= rest - 1;
+            }
+            return w * 64 + __builtin_ctzll(rest);
+        }
+        return -1;
+    }
+};
+
+/*
+    The moves worth searching. Discards that leave more than discardSlack deadwood over
+    the best one are left out: a round is too noisy for a few thousand playouts to tell
+    a bad discard from a fair one, so the tree only chooses among the close ones, where
+    what is known about the opponent's hand can make the difference.
+*/
+inline ActionSet legal_actions(const Round& round, int discardSlack) {
+    ActionSet set;
+    switch (round.phase()) {
+        case Round::Draw:
+            set.add(ActDrawStock);
+            if (round.has_discard()) {
+                set.add(ActDrawDiscard);
+            }
+            break;
+        case Round::Discard: {
+            DiscardChoice choices[default_deck];
+            int count = evaluate_discards(round.hand(round.to_move()), choices);
+            int least = choices[0].deadwood;
+            for (int i = 1; i < count; ++i) {
+                least = std::min(least, choices[i].deadwood);
+            }
+            for (int i = 0; i < count; ++i) {
+                if (choices[i].deadwood <= least + discardSlack) {
+                    set.add(ActDiscard + __builtin_ctzll(card_bit(choices[i].card)));
+                }
+            }
+            break;
+        }
+        case Round::Knock:
+            set.add(ActPlayOn);
+            set.add(ActKnock);
+            break;
+        case Round::Over:
+            break;
+    }
+    return set;
+}
+
+inline void apply_action(Round& round, int action) {
+    Card drawn;
+    if (action == ActDrawStock || action == ActDrawDiscard) {
+        round.draw(action == ActDrawDiscard, drawn);
+    } else if (action == ActPlayOn || action == ActKnock) {
+        round.knock(action == ActKnock);
+    } else {
+        round.discard(bit_card(action - ActDiscard));
+    }
+}
+
+// plays the round to the end with the same policy on both seats
+inline void play_out(Round& round, PlayerPolicy& policy) {
+    Card drawn;
+    while (round.phase() != Round::Over) {
+        TurnView view = turn_view(round);
+        switch (round.phase()) {
+            case Round::Draw:
+                round.draw(policy.draw_from_discard(view), drawn);
+                break;
+            case Round::Discard:
+                if (!round.discard(policy.choose_discard(view))) {
+                    int deadwood;
+                    round.discard(best_discard(view.hand, deadwood));
+                }
+                break;
+            case Round::Knock:
+                round.knock(policy.knock(view, round.deadwood()));
+                break;
+            case Round::Over:
+                break;
+        }
+    }
+}
+
+struct SearchNode {
+    int32_t firstChild;
+    int32_t sibling;
+    uint32 visits;
+    uint32 available;   // iterations in which this move was legal
+    float reward;       // summed, as seen by seat
+    uint8 action;
+    uint8 seat;         // who made the move
+};
+
+/*
+    One thread's tree. search() fills visits[] with the root's visit count per action.
+*/
+class SearchTree
+{
+private:
+    static constexpr int maxDepth = 512;
+    static constexpr float exploration = 0.25f;
+    static constexpr int discardSlack = 5;
+
+    std::vector<SearchNode> nodes;
+    int used = 0;
+    Rng rng;
+    Deck deck{Rng(0)};
+    Round round;
+    GreedyPolicy rollout;
+
+    const TurnView* view = nullptr;
+    Round::Phase rootPhase = Round::Over;
+    HandMask unseen = 0;
+    int opponentUnknown = 0;
+
+    // everything the mover can't see, dealt at random: the opponent's unknown cards and the stock
+    void determinize() {
+        Card cards[default_deck];
+        int n = 0;
+        for (HandMask rest = unseen; rest; rest &= rest - 1) {
+            cards[n++] = bit_card(__builtin_ctzll(rest));
+        }
+        for (int i = 0; i + 1 < n; ++i) {
+            std::swap(cards[i], cards[i + rng.below(uint32(n - i))]);
+        }
+        HandMask hands[2];
+        HandMask pickups[2];
+        hands[view->seat] = view->hand;
+        pickups[view->seat] = 0;
+        pickups[1 - view->seat] = view->opponentPickups;
+        hands[1 - view->seat] = view->opponentPickups;
+        for (int i = 0; i < opponentUnknown; ++i) {
+            hands[1 - view->seat] |= card_bit(cards[i]);
+        }
+        deck.load(cards + opponentUnknown, uint16(n - opponentUnknown));
+        round.resume(deck, hands, view->discards, view->discardCount, pickups,
+                     view->seat, view->turn, rootPhase);
+    }
+
+    int add_node(int parent, int action, int seat) {
+        SearchNode& node = nodes[used];
+        node.firstChild = -1;
+        node.sibling = nodes[parent].firstChild;
+        node.visits = 0;
+        node.available = 1;
+        node.reward = 0;
+        node.action = uint8(action);
+        node.seat = uint8(seat);
+        nodes[parent].firstChild = used;
+        return used++;
+    }
+
+    // points scored this round as seen by seat, scaled to about [-1, 1]
+    static float reward_for(const RoundResult& result, int seat) {
+        if (result.winner < 0) {
+            return 0;
+        }
+        float points = float(result.points) / 100.0f;
+        return result.winner == seat ? points : -points;
+    }
+
+    void iterate() {
+        determinize();
+
+        int path[maxDepth];
+        int depth = 0;
+        int node = 0;
+        while (round.phase() != Round::Over && depth < maxDepth) {
+            ActionSet legal = legal_actions(round, discardSlack);
+            ActionSet tried;
+            for (int child = nodes[node].firstChild; child >= 0; child = nodes[child].sibling) {
+                if (legal.has(nodes[child].action)) {
+                    tried.add(nodes[child].action);
+                    nodes[child].available++;
+                }
+            }
+
+            ActionSet untried;
+            untried.bits[0] = legal.bits[0] & ~tried.bits[0];
+            untried.bits[1] = legal.bits[1] & ~tried.bits[1];
+            int untriedCount = untried.count();
+            if (untriedCount > 0 && used < int(nodes.size())) {
+                int action = untried.nth(int(rng.below(uint32(untriedCount))));
+                node = add_node(node, action, round.to_move());
+                apply_action(round, action);
+                path[depth++] = node;
+                break;
+            }
+            if (tried.count() == 0) {
+                break;      // pool is full and nothing here has been tried
+            }
+
+            int best = -1;
+            float bestScore = 0;
+            for (int child = nodes[node].firstChild; child >= 0; child = nodes[child].sibling) {
+                const SearchNode& c = nodes[child];
+                if (!legal.has(c.action)) {
+                    continue;
+                }
+                float score = c.reward / c.visits +
+                              exploration * std::sqrt(std::log(float(c.available)) / c.visits);
+                if (best < 0 || score > bestScore) {
+                    best = child;
+                    bestScore = score;
+                }
+            }
+            node = best;
+            apply_action(round, nodes[node].action);
+            path[depth++] = node;
+        }
+
+        play_out(round, rollout);
+        const RoundResult& result = round.result();
+        for (int i = 0; i < depth; ++i) {
+            SearchNode& n = nodes[path[i]];
+            n.visits++;
+            n.reward += reward_for(result, n.seat);
+        }
+        nodes[0].visits++;
+    }
+
+public:
+    explicit SearchTree(int poolSize) : nodes(size_t(poolSize)) {}
+
+    /*
+        The unknown cards have to add up: what isn't in view must be exactly the
+        opponent's hidden cards plus the stock. False if they don't (a shoe, or a
+        view without the pile history), and then there is nothing to search.
+    */
+    static bool can_search(const TurnView& v) {
+        if (!v.discards || v.counts.repeated()) {
+            return false;
+        }
+        HandMask seen = v.hand | v.opponentPickups;
+        for (int i = 0; i < v.discardCount; ++i) {
+            seen |= card_bit(v.discards[i]);
+        }
+        int hidden = v.opponentCards - card_count(v.opponentPickups);
+        return hidden >= 0 && card_count(all_cards & ~seen) == hidden + v.stockRemaining;
+    }
+
+    // runs until deadline, or for exactly maxIterations if that is above 0
+    uint64 search(const TurnView& v, Round::Phase phase, uint64 seed,
+                  std::chrono::steady_clock::time_point deadline, uint64 maxIterations,
+                  uint64* visits) {
+        view = &v;
+        rootPhase = phase;
+        rng.reseed(seed);
+        HandMask seen = v.hand | v.opponentPickups;
+        for (int i = 0; i < v.discardCount; ++i) {
+            seen |= card_bit(v.discards[i]);
+        }
+        unseen = all_cards & ~seen;
+        opponentUnknown = v.opponentCards - card_count(v.opponentPickups);
+
+        used = 0;
+        nodes[used++] = SearchNode{-1, -1, 0, 0, 0, 0, uint8(v.seat)};
+
+        // at least one iteration, so there is always a move to give back
+        uint64 iterations = 0;
+        do {
+            iterate();
+            ++iterations;
+        } while (maxIterations ? iterations < maxIterations
+                               : std::chrono::steady_clock::now() < deadline);
+
+        for (int child = nodes[0].firstChild; child >= 0; child = nodes[child].sibling) {
+            visits[nodes[child].action] += nodes[child].visits;
+        }
+        return iterations;
+    }
+};
+
+class SearchPolicy : public PlayerPolicy
+{
+private:
+    static constexpr int poolSize = 1 << 16;   // nodes per thread, far more than 50 ms fills
+
+    int budgetMs;
+    uint64 maxIterations;
+    uint64 seed;
+    uint64 moves = 0;
+    uint64 lastIterations = 0;
+    std::vector<std::unique_ptr<SearchTree>> trees;
+    GreedyPolicy fallback;
+
+    // the most visited root move over every thread's tree
+    int search(const TurnView& view, Round::Phase phase) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(budgetMs);
+        uint64 visits[search_actions] = {};
+        uint64 treeVisits[16][search_actions] = {};
+        uint64 counts[16] = {};
+        size_t threads = trees.size();
+        uint64 perTree = maxIterations ? (maxIterations + threads - 1) / threads : 0;
+        uint64 moveSeed = mix_seed(seed + moves++);
+
+        std::vector<std::thread> helpers;
+        for (size_t t = 1; t < threads; ++t) {
+            helpers.emplace_back([&, t] {
+                counts[t] = trees[t]->search(view, phase, mix_seed(moveSeed + t), deadline,
+                                             perTree, treeVisits[t]);
+            });
+        }
+        counts[0] = trees[0]->search(view, phase, moveSeed, deadline, perTree, treeVisits[0]);
+        for (std::thread& h : helpers) {
+            h.join();
+        }
+
+        lastIterations = 0;
+        for (size_t t = 0; t < threads; ++t) {
+            lastIterations += counts[t];
+            for (int a = 0; a < search_actions; ++a) {
+                visits[a] += treeVisits[t][a];
+            }
+        }
+
+        int best = -1;
+        for (int a = 0; a < search_actions; ++a) {
+            if (visits[a] > 0 && (best < 0 || visits[a] > visits[best])) {
+                best = a;
+            }
+        }
+        return best;
+    }
+
+public:
+    /*
+        budgetMs of thinking per decision on threads threads (0 = every core, at most 16).
+        With maxIterations above 0 the budget is ignored and every decision runs exactly
+        that many iterations, which makes the player repeatable for a given seed.
+    */
+    explicit SearchPolicy(int budgetMs = 50, unsigned threads = 0, uint64 maxIterations = 0,
+                          uint64 seed = 0)
+        : budgetMs(budgetMs), maxIterations(maxIterations), seed(seed) {
+        if (threads == 0) {
+            threads = std::thread::hardware_concurrency();
+        }
+        threads = threads < 1 ? 1 : threads > 16 ? 16 : threads;
+        for (unsigned t = 0; t < threads; ++t) {
+            trees.emplace_back(new SearchTree(poolSize));
+        }
+    }
+
+    bool draw_from_discard(const TurnView& view) override {
+        if (!view.hasDiscard) {
+            return false;
+        }
+        if (!SearchTree::can_search(view)) {
+            return fallback.draw_from_discard(view);
+        }
+        return search(view, Round::Draw) == ActDrawDiscard;
+    }
+
+    Card choose_discard(const TurnView& view) override {
+        if (!SearchTree::can_search(view)) {
+            return fallback.choose_discard(view);
+        }
+        return bit_card(search(view, Round::Discard) - ActDiscard);
+    }
+
+    bool knock(const TurnView& view, int deadwood) override {
+        if (!SearchTree::can_search(view)) {
+            return fallback.knock(view, deadwood);
+        }
+        return search(view, Round::Knock) == ActKnock;
+    }
+
+    void reseed(uint64 s) override {
+        seed = s;
+        moves = 0;
+    }
+
+    // iterations the last decision ran, over all threads
+    uint64 iterations() const {
+        return lastIterations;
+    }
+};
+
+#endif /* ismcts_h */
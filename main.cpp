@@ -1,39 +1,57 @@
 #include <iostream>
 #include "deck.h"
-#include <stack>
-#include <unordered_map>
+#include "card_utils.h"
+#include "gin_rummy.h"
+#include "game_io.h"
+#include "game_log.h"
+#include "ismcts.h"
+#include "metrics.h"
+#include "engine_protocol.h"
+#include "hand_values.h"
+#include "outs.h"
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
 #include <vector>
-#include <set>
 #include <limits>
-#include <thread>
-#include <chrono>
 
 using namespace std;
 
-// global flag to control delays (set to false for faster game)
-const bool ENABLE_DELAYS = true;
-const int DELAY_MS = 800;  // milliseconds between messages
+// all output goes through here; the pace comes from the command line
+Renderer screen;
+const int DELAY_MS = 800;  // milliseconds between messages at normal pace
 const int HAND_SIZE = 3;
+const int METRICS_INTERVAL_MS = 5000;  // how often --metrics rewrites its file
 
-// Custom delayed cout
+// every round is recorded here, and written out when --log names a file
+GameLogWriter gameLog;
+RoundLog roundLog(gameLog);
+
+// what starting hands are worth, when --hand-values names a table from handdb
+HandValueTable handValues;
+
+// narration, paced by the renderer
 void print_delayed(const string& message, bool newline = true) {
-    if (ENABLE_DELAYS) {
-        this_thread::sleep_for(chrono::milliseconds(DELAY_MS));
-    }
-    cout << message;
-    if (newline) {
-        cout << '\n';
-    }
-    cout.flush();
+    screen.say(message, newline);
 }
 
-// for instant printing (such as in prompts, user input)
+// for instant printing (such as hands and cards)
 void print_instant(const string& message, bool newline = true) {
-    cout << message;
-    if (newline) {
-        cout << '\n';
+    screen.show(message, newline);
+}
+
+// results that --quiet still shows
+void print_result(const string& message) {
+    screen.result(message);
+}
+
+// scripted input can run out; stop instead of asking forever
+void check_input_open() {
+    if (cin.eof()) {
+        screen.alert("\nInput closed.");
+        screen.drain();
+        exit(0);
     }
-    cout.flush();
 }
 
 // input validation
@@ -42,20 +60,22 @@ int get_valid_input(const string& prompt, int minVal, int maxVal) {
     int choice;
     while (true) {
         //print message and get user's choice
-        print_instant(prompt, false);
+        screen.prompt(prompt);
         cin >> choice;
+        screen.hurry();
+        check_input_open();
         
         // check if input was a non-number
         if (cin.fail()) {
             cin.clear();
             //ignore all non-numerical chars
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            print_delayed("Invalid input! Please enter a number.");
+            screen.alert("Invalid input! Please enter a number.");
         }
         // check if choice is in valid range
         else if (choice < minVal || choice > maxVal) {
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            print_delayed("Out of range! Enter a number between " + to_string(minVal) + 
+            screen.alert("Out of range! Enter a number between " + to_string(minVal) + 
                          " and " + to_string(maxVal) + ".");
         }
         // else, input is valid
@@ -66,155 +86,30 @@ int get_valid_input(const string& prompt, int minVal, int maxVal) {
     }
 }
 
-void display_hand(const vector<Card>& hand) {
-    cout << '[';
+void display_hand(const CardPile& hand) {
+    string line = "[";
     for (const Card& c : hand) {
-        cout << " " << c;
+        line += " " + card_name(c);
     }
-    cout << "]\n";
+    print_instant(line + "]");
 }
 
-/*
-    A set in Gin Rummy is a list of 3+ cards with the same rank, but different suits
-    eg. 3S, 3D, 3H
-*/
-vector<vector<Card>> find_sets(const vector<Card>& hand) {
-    vector<vector<Card>> sets;
-    
-    // map with key: rank, value: vector of cards with that rank
-    unordered_map<uint8, vector<Card>> rankMap;
-    
-    for (const Card& c : hand) {
-        rankMap[c.rank].push_back(c);
+// a meld, in suit then rank order
+void display_hand(HandMask meld) {
+    string line = "[";
+    for (HandMask rest = meld; rest; rest &= rest - 1) {
+        line += " " + card_name(bit_card(__builtin_ctzll(rest)));
     }
-
-    for (auto& [rank, cards] : rankMap) {
-        if (cards.size() >= 3) {
-            // verify different suits
-            set<uint8> suits;
-            for (const Card& c : cards) {
-                suits.insert(c.suit);
-            }
-            
-            // we must have at least 3 different suits for it to be a set
-            if (suits.size() >= 3) {
-                // get the cards with different suits
-                vector<Card> validSet;
-                set<uint8> usedSuits;
-                
-                for (const Card& c : cards) {
-                    if (usedSuits.find(c.suit) == usedSuits.end()) {
-                        validSet.push_back(c);
-                        usedSuits.insert(c.suit);
-                    }
-                }
-                
-                if (validSet.size() >= 3) {
-                    sets.push_back(validSet);
-                }
-            }
-        }
-    }
-
-    return sets;
-}
-
-/*
-    A run in Gin Rummy is a list of 3+ cards with the same suit, but consecutive ranks
-    eg. AS, 2S, 3S
-*/
-vector<vector<Card>> find_runs(const vector<Card>& hand) {
-    vector<vector<Card>> runs;
-    
-    // map with key: suit, value: cards of that suit
-    unordered_map<uint8, vector<Card>> suitMap;
-    
-    // add all cards to relevant place in map
-    for (const Card& c : hand) {
-        suitMap[c.suit].push_back(c);
-    }
-    
-    // for each suit, find consecutive runs
-    for (auto& [suit, cards] : suitMap) {
-        // we need at least 3 cards for a run
-        if (cards.size() >= 3) {
-            // sort cards by rank + find consecutive sequences
-            sort(cards.begin(), cards.end(), [](Card a, Card b) {
-                return a.rank < b.rank;
-            });
-            
-            vector<Card> currentRun = {cards[0]};
-            
-            for (size_t i = 1; i < cards.size(); i++) {
-                // compare current card's rank to the most-recently added one
-                if (cards[i].rank == currentRun.back().rank + 1) {
-                    // we have a consecutive card - add it to the run
-                    currentRun.push_back(cards[i]);
-                } else {
-                    // we found a gap so this is the end of that run
-                    // check if the run is valid
-                    if (currentRun.size() >= 3) {
-                        runs.push_back(currentRun);
-                    }
-                    // start new run
-                    currentRun = {cards[i]};
-                }
-            }
-            
-            // Don't forget to check the lastrun
-            if (currentRun.size() >= 3) {
-                runs.push_back(currentRun);
-            }
-        }   
-    }
-    
-    return runs;
-}
-
-int calculate_deadwood(const vector<Card>& hand, 
-                      const vector<vector<Card>>& sets,
-                      const vector<vector<Card>>& runs) {
-    // collect all cards that are in melds
-    set<pair<uint8, uint8>> meldedCards;
-    
-    // add all cards from sets & runs
-    for (const auto& meld : sets) {
-        for (const Card& c : meld) {
-            meldedCards.insert({c.suit, c.rank});
-        }
-    }
-    
-    for (const auto& meld : runs) {
-        for (const Card& c : meld) {
-            meldedCards.insert({c.suit, c.rank});
-        }
-    }
-    
-    // calculate points for unmelded cards
-    int deadwood = 0;
-    for (const Card& c : hand) {
-        // check if card is NOT in any meld
-        if (meldedCards.find({c.suit, c.rank}) == meldedCards.end()) {
-            if (c.rank == 1) {
-                deadwood += 1;
-            } else if (c.rank >= 10) {
-                deadwood += 10;
-            } else {
-                deadwood += c.rank;
-            }
-        }
-    }
-    
-    return deadwood;
+    print_instant(line + "]");
 }
 
 /*
     Display the user's sets and runs to the
 */
-void display_melds(const vector<vector<Card>>& sets, const vector<vector<Card>>& runs) {
+void display_melds(const MeldList& sets, const MeldList& runs) {
     if (!sets.empty()) {
         print_instant("Sets found:");
-        for (const auto& cardSet : sets) {
+        for (HandMask cardSet : sets) {
             print_instant("  ", false);
             display_hand(cardSet);
         }
@@ -222,7 +117,7 @@ void display_melds(const vector<vector<Card>>& sets, const vector<vector<Card>>&
     
     if (!runs.empty()) {
         print_instant("Runs found:");
-        for (const auto& cardRun : runs) {
+        for (HandMask cardRun : runs) {
             print_instant("  ", false);
             display_hand(cardRun);
         }
@@ -233,15 +128,26 @@ void display_melds(const vector<vector<Card>>& sets, const vector<vector<Card>>&
     }
 }
 
-void score_round(const string& knockerName, const vector<Card>& knockerHand,
-                const vector<vector<Card>>& knockerSets, const vector<vector<Card>>& knockerRuns,
+// prints the hands and scores a knock; returns the opponent's layoffs
+LayoffResult score_round(const string& knockerName, const CardPile& knockerHand,
+                const MeldList& knockerSets, const MeldList& knockerRuns,
                 int& knockerScore,
-                const string& opponentName, const vector<Card>& opponentHand,
-                const vector<vector<Card>>& opponentSets, const vector<vector<Card>>& opponentRuns,
+                const string& opponentName, const CardPile& opponentHand,
+                const MeldList& opponentSets, const MeldList& opponentRuns,
                 int& opponentScore) {
     
-    int knockerDeadwood = calculate_deadwood(knockerHand, knockerSets, knockerRuns);
-    int opponentDeadwood = calculate_deadwood(opponentHand, opponentSets, opponentRuns);
+    // melds passed in are each player's best arrangement, so they never overlap
+    int knockerDeadwood;
+    LayoffResult layoff;
+    {
+        metrics::PhaseTimer timer(metrics::Phase::ScoreRound);
+        knockerDeadwood = calculate_deadwood(to_mask(knockerHand), knockerSets, knockerRuns);
+        int opponentDeadwood = calculate_deadwood(to_mask(opponentHand), opponentSets, opponentRuns);
+        layoff = {opponentDeadwood, 0};
+        if (knockerDeadwood > 0) {
+            layoff = resolve_layoffs(to_mask(knockerHand), to_mask(opponentHand));
+        }
+    }
     
     print_delayed("\n========== SCORING ==========");
     print_delayed(knockerName + "'s final hand:");
@@ -252,28 +158,70 @@ void score_round(const string& knockerName, const vector<Card>& knockerHand,
     print_delayed("\n" + opponentName + "'s final hand:");
     display_hand(opponentHand);
     display_melds(opponentSets, opponentRuns);
-    print_delayed(opponentName + " deadwood: " + to_string(opponentDeadwood) + " points");
-    
-    if (knockerDeadwood == 0) {
-        // GIN
-        int points = opponentDeadwood + 25;
-        knockerScore += points;
-        print_delayed("\n GIN! " + knockerName + " scores " + to_string(points) + " points!");
-    } else if (opponentDeadwood < knockerDeadwood) {
-        // UNDERCUT
-        int points = (knockerDeadwood - opponentDeadwood) + 25;
-        opponentScore += points;
-        print_delayed("\n UNDERCUT! " + opponentName + " scores " + to_string(points) + " points!");
+    if (layoff.laidOff) {
+        print_delayed(opponentName + " lays off: ", false);
+        display_hand(layoff.laidOff);
+    }
+    print_delayed(opponentName + " deadwood: " + to_string(layoff.deadwood) + " points");
+    
+    KnockResult result = score_knock(knockerDeadwood, layoff.deadwood);
+    if (result.type == RoundEnd::Gin) {
+        knockerScore += result.points;
+        print_result("\n GIN! " + knockerName + " scores " + to_string(result.points) + " points!");
+    } else if (result.type == RoundEnd::Undercut) {
+        opponentScore += result.points;
+        print_result("\n UNDERCUT! " + opponentName + " scores " + to_string(result.points) + " points!");
     } else {
-        // Normal knock
-        int points = opponentDeadwood - knockerDeadwood;
-        knockerScore += points;
-        print_delayed("\n✓ " + knockerName + " scores " + to_string(points) + " points.");
+        knockerScore += result.points;
+        print_result("\n✓ " + knockerName + " scores " + to_string(result.points) + " points.");
     }
     
-    print_delayed("\n--- Current Scores ---");
-    print_delayed(knockerName + ": " + to_string(knockerScore));
-    print_delayed(opponentName + ": " + to_string(opponentScore));
+    print_result("\n--- Current Scores ---");
+    print_result(knockerName + ": " + to_string(knockerScore));
+    print_result(opponentName + ": " + to_string(opponentScore));
+    return layoff;
+}
+
+// what a computer player gets to see on its turn
+TurnView bot_view(const Deck& deck, const IncrementalHand& hand, const CardPile& discardPile,
+                  HandMask opponentTaken) {
+    TurnView view;
+    view.seat = 0;
+    view.turn = 0;
+    view.hand = hand.bits();
+    view.counts.add(view.hand);
+    view.hasDiscard = !discardPile.empty();
+    view.topDiscard = view.hasDiscard ? discardPile.back() : Card{0, 0};
+    view.stockRemaining = deck.remaining();
+    view.discards = discardPile.empty() ? nullptr : &discardPile[0];
+    view.discardCount = uint16(discardPile.size());
+    view.opponentPickups = opponentTaken;
+    view.opponentCards = HAND_SIZE;
+    return view;
+}
+
+/*
+    For each card the player could throw, in the order the hand is shown: what the
+    rest could draw into from the cards it hasn't seen, and the chance of drawing it
+    within the next few turns (see outs.h).
+*/
+void display_outs(const TurnView& view, const CardPile& cards) {
+    DiscardOuts options[default_deck];
+    int count = live_outs(view, outs_draws, options);
+    int draws = min(outs_draws, int(view.stockRemaining));
+    print_instant("\nIf you throw (outs to knock / gin, chance in " + to_string(draws) + " draws):");
+    for (size_t i = 0; i < cards.size(); ++i) {
+        for (int j = 0; j < count; ++j) {
+            if (options[j].discard == cards[i]) {
+                char line[128];
+                snprintf(line, sizeof(line), "%2zu. %s  deadwood %2d, %2d to knock (%3.0f%%), %2d to gin (%3.0f%%)",
+                         i + 1, card_name(cards[i]).c_str(), options[j].deadwood,
+                         card_count(options[j].knockOuts), 100 * options[j].knockChance,
+                         card_count(options[j].ginOuts), 100 * options[j].ginChance);
+                print_instant(line);
+            }
+        }
+    }
 }
 
 /*
@@ -282,117 +230,225 @@ void score_round(const string& knockerName, const vector<Card>& knockerHand,
         Seeing the melds
         Calculating deadwood
         Offering player to knock if applicable
+    bot is nullptr for a human; otherwise it makes every choice instead of a prompt
+    and the computer's hand stays hidden. taken is the cards this player has picked
+    off the discard pile and still holds, which the other player gets to know about.
 */
-void take_turn(Deck& deck, vector<Card>& hand, const string& playerName, 
-              stack<Card>& discardPile, vector<vector<Card>>& playerSets, 
-              vector<vector<Card>>& playerRuns, bool& knocked) {
+void take_turn(Deck& deck, IncrementalHand& hand, const string& playerName, 
+              CardPile& discardPile, MeldList& playerSets, 
+              MeldList& playerRuns, bool& knocked, HandMask& taken, HandMask opponentTaken,
+              PlayerPolicy* bot = nullptr) {
     
     print_delayed("\n========================================");
     print_delayed(playerName + "'s Turn");
     print_delayed("========================================");
     
     print_instant("\nCards remaining in stock: " + to_string(deck.remaining()));
-    print_instant("Top of discard pile: ", false);
-    cout << discardPile.top();
+    print_instant("Top of discard pile: " + card_name(discardPile.back()), false);
     
-    print_instant("\n" + playerName + "'s hand:");
-    display_hand(hand);
+    if (!bot) {
+        print_instant("\n" + playerName + "'s hand:");
+        display_hand(hand.cards());
+    }
     
     // DRAW PHASE
-    print_instant("\nChoose an action:");
-    print_instant("1. Draw from stock pile");
-    print_instant("2. Draw from discard pile");
-    
-    int choice = get_valid_input("Your choice: ", 1, 2);
+    int choice;
+    {
+        metrics::PhaseTimer timer(metrics::Phase::DrawDecision);
+        if (bot) {
+            choice = bot->draw_from_discard(bot_view(deck, hand, discardPile, opponentTaken)) ? 2 : 1;
+        } else {
+            print_instant("\nChoose an action:");
+            print_instant("1. Draw from stock pile");
+            print_instant("2. Draw from discard pile");
+        
+            choice = get_valid_input("Your choice: ", 1, 2);
+        }
+    }
     
     Card drawn;
+    bool fromDiscard = choice == 2;
     if (choice == 1) {
         if (deck.isEmpty()) {
             print_delayed("Stock pile is empty! Drawing from discard instead.");
-            drawn = discardPile.top();
-            discardPile.pop();
+            drawn = discardPile.back();
+            discardPile.pop_back();
+            fromDiscard = true;
         } else {
             drawn = deck.deal_card();
-            print_delayed("You drew from stock: ", false);
-            cout << drawn;
+            if (bot) {
+                print_delayed("\n" + playerName + " drew from stock.", false);
+            } else {
+                print_delayed("You drew from stock: ", false);
+                print_instant(card_name(drawn), false);
+            }
         }
     } else {
         // in case the discard pile has no cards, but it should always have >=1
         if (discardPile.empty()) {
             print_delayed("Discard pile is empty! Drawing from stock instead.");
             drawn = deck.deal_card();
+            fromDiscard = false;
         } else {
-            drawn = discardPile.top();
-            discardPile.pop();
-            print_delayed("You took from discard: ", false);
-            cout << drawn;
+            drawn = discardPile.back();
+            discardPile.pop_back();
+            print_delayed(bot ? "\n" + playerName + " took from discard: " : "You took from discard: ", false);
+            print_instant(card_name(drawn), false);
         }
     }
 
-    // pick up card
-    hand.push_back(drawn);
-
-    print_delayed("\nUpdated hand:");
-    display_hand(hand);
-    
-    // Find melds before discard
-    playerSets = find_sets(hand);
-    playerRuns = find_runs(hand);
-    display_melds(playerSets, playerRuns);
+    // pick up card, only its suit and rank get re-checked for melds
+    hand.add(drawn);
+    if (fromDiscard) {
+        taken |= card_bit(drawn);
+    }
+    roundLog.draw(fromDiscard, drawn);
 
     // DISCARD PHASE
-    int discardChoice = get_valid_input("\nWhich card to discard (1-" + 
-                                        to_string(hand.size()) + ")? ", 1, hand.size());
+    int discardChoice;
+    {
+        metrics::PhaseTimer timer(metrics::Phase::DiscardDecision);
+        if (bot) {
+            Card pick = bot->choose_discard(bot_view(deck, hand, discardPile, opponentTaken));
+            if (!(hand.bits() & card_bit(pick))) {
+                // a policy that names a card it doesn't hold loses that choice, as in GameEngine
+                int deadwood;
+                pick = best_discard(hand.bits(), deadwood);
+            }
+            discardChoice = 1;
+            while (size_t(discardChoice) < hand.size() && !(hand.cards()[discardChoice - 1] == pick)) {
+                discardChoice++;
+            }
+        } else {
+            print_delayed("\nUpdated hand:");
+            display_hand(hand.cards());
+        
+            // Find melds before discard
+            playerSets = hand.sets();
+            playerRuns = hand.runs();
+            display_melds(playerSets, playerRuns);
+            display_outs(bot_view(deck, hand, discardPile, opponentTaken), hand.cards());
+
+            discardChoice = get_valid_input("\nWhich card to discard (1-" + 
+                                            to_string(hand.size()) + ")? ", 1, hand.size());
+        }
+    }
 
-    Card discarded = hand[discardChoice - 1];
-    hand.erase(hand.begin() + discardChoice - 1);
-    discardPile.push(discarded);
+    Card discarded = hand.remove_at(discardChoice - 1);
+    discardPile.push_back(discarded);
+    taken &= ~card_bit(discarded);
+    roundLog.discard(discarded);
     
-    print_delayed("You discarded: ", false);
-    cout << discarded;
+    print_delayed(bot ? "\n" + playerName + " discarded: " : "You discarded: ", false);
+    print_instant(card_name(discarded), false);
 
-    // Recalculate melds after discard
-    playerSets = find_sets(hand);
-    playerRuns = find_runs(hand);
+    // Find the best non-overlapping arrangement after discard
+    hand.best_melds(playerSets, playerRuns);
     
-    int deadwood = calculate_deadwood(hand, playerSets, playerRuns);
-    print_delayed("\nYour deadwood: " + to_string(deadwood) + " points");
+    int deadwood = hand.deadwood();
+    if (!bot) {
+        print_delayed("\nYour deadwood: " + to_string(deadwood) + " points");
+    }
 
     // KNOCK CHECK
     if (deadwood == 0) {
         print_delayed("\n" + playerName + " has GIN! ");
         knocked = true;
-    } else if (deadwood <= 10) {
-        print_delayed("\n" + playerName + ", you can knock (deadwood = " + 
-                     to_string(deadwood) + ")");
-        int knockChoice = get_valid_input("Do you want to knock? (1=Yes, 2=No): ", 1, 2);
+        roundLog.knock(true);
+    } else if (deadwood <= knock_limit) {
+        int knockChoice;
+        if (bot) {
+            knockChoice = bot->knock(bot_view(deck, hand, discardPile, opponentTaken), deadwood) ? 1 : 2;
+        } else {
+            print_delayed("\n" + playerName + ", you can knock (deadwood = " + 
+                         to_string(deadwood) + ")");
+            knockChoice = get_valid_input("Do you want to knock? (1=Yes, 2=No): ", 1, 2);
+        }
         
+        roundLog.knock(knockChoice == 1);
         if (knockChoice == 1) {
             print_delayed("\n" + playerName + " knocks!");
             knocked = true;
-        } else {
+        } else if (!bot) {
             print_delayed(playerName + " chooses to continue playing.");
         }
     }
+
+    // the whole turn goes to the screen in one go
+    screen.flush();
 }
 
 /*
     Here, the main gameplay logic happens
 */
 int main(int argc, const char * argv[]) {
+    Pace pace = Pace::Normal;
+    bool engine = false;
+    unique_ptr<metrics::MetricsExporter> exporter;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--log" && i + 1 < argc) {
+            if (!gameLog.open(argv[++i])) {
+                cout << "Can't write a game log to " << argv[i] << '\n';
+                return 1;
+            }
+        } else if (arg == "--metrics" && i + 1 < argc && metrics::enabled) {
+            exporter.reset(new metrics::MetricsExporter(argv[++i], METRICS_INTERVAL_MS));
+        } else if (arg == "--engine") {
+            engine = true;
+        } else if (arg == "--hand-values" && i + 1 < argc) {
+            if (!handValues.open(argv[++i]) || handValues.hand_size() != HAND_SIZE) {
+                cout << argv[i] << " isn't a table of " << HAND_SIZE << "-card hands (see handdb)\n";
+                return 1;
+            }
+        } else if (!parse_pace(arg, pace)) {
+            cout << "usage: gin_rummy [--fast | --instant | --quiet | --engine] [--log games.log]"
+                    " [--hand-values hands.db]"
+                 << (metrics::enabled ? " [--metrics file]" : "") << "\n";
+            return 1;
+        }
+    }
+    if (engine) {
+        // another program drives the game over stdin / stdout, see engine_protocol.h
+        ios::sync_with_stdio(false);
+        return run_engine(cin, cout, gameLog.is_open() ? &roundLog : nullptr);
+    }
+    screen.set_pace(pace, DELAY_MS);
+
     print_delayed("=== GIN RUMMY ===\n");
     
+    // either seat can be the computer, so two bots can also play each other
+    // a strong computer searches each move for half a second instead
+    BotPolicy p1Bot, p2Bot;
+    SearchPolicy p1Search(500), p2Search(500);
+    PlayerPolicy* p1Player = nullptr;
+    PlayerPolicy* p2Player = nullptr;
+    
     string p1Name, p2Name;
-    print_instant("Player 1 name: ", false);
-    getline(cin, p1Name);
-    print_instant("Player 2 name: ", false);
-    getline(cin, p2Name);
+    int p1Choice = get_valid_input("Player 1: 1=Human, 2=Computer, 3=Strong computer? ", 1, 3);
+    if (p1Choice != 1) {
+        p1Player = p1Choice == 3 ? (PlayerPolicy*) &p1Search : &p1Bot;
+        p1Name = "Computer 1";
+    } else {
+        screen.prompt("Player 1 name: ");
+        getline(cin, p1Name);
+        screen.hurry();
+    }
+    int p2Choice = get_valid_input("Player 2: 1=Human, 2=Computer, 3=Strong computer? ", 1, 3);
+    if (p2Choice != 1) {
+        p2Player = p2Choice == 3 ? (PlayerPolicy*) &p2Search : &p2Bot;
+        p2Name = "Computer 2";
+    } else {
+        screen.prompt("Player 2 name: ");
+        getline(cin, p2Name);
+        screen.hurry();
+    }
     
     if (p1Name.empty()) p1Name = "Player 1";
     if (p2Name.empty()) p2Name = "Player 2";
     
     print_delayed("\nWelcome " + p1Name + " and " + p2Name + "!");
-    print_delayed("First to 100 points wins the game.");
+    print_delayed("First to " + to_string(game_target) + " points wins the game.");
     print_delayed("Let's begin!\n");
     
     int p1Score = 0;
@@ -409,56 +465,67 @@ int main(int argc, const char * argv[]) {
                      " - " + p2Name + " " + to_string(p2Score));
         
         // deal hands to each player etc
-        Deck deck;
-        vector<Card> p1Hand = deck.deal_hand(HAND_SIZE);
-        vector<Card> p2Hand = deck.deal_hand(HAND_SIZE);
-        vector<vector<Card>> p1Sets, p1Runs;
-        vector<vector<Card>> p2Sets, p2Runs;
+        // the seed is all the log needs to deal this round again
+        uint64 roundSeed = fresh_seed();
+        Deck deck{Rng(roundSeed)};
+        roundLog.begin(roundSeed, HAND_SIZE, 0, 1);
+        // all of a round's cards and melds live in fixed storage on the stack
+        IncrementalHand p1Hand, p2Hand;
+        {
+            metrics::PhaseTimer timer(metrics::Phase::Deal);
+            p1Hand = IncrementalHand(deck, HAND_SIZE);
+            p2Hand = IncrementalHand(deck, HAND_SIZE);
+        }
+        MeldList p1Sets, p1Runs;
+        MeldList p2Sets, p2Runs;
+        const HandMask openingHands[2] = {p1Hand.bits(), p2Hand.bits()};
         
-        if (p1Hand.empty() || p2Hand.empty()) {
+        if (p1Hand.size() == 0 || p2Hand.size() == 0) {
             print_delayed("Error dealing cards. Exiting.");
             break;
         }
         
-        stack<Card> discardPile;
-        discardPile.push(deck.deal_card());
+        CardPile discardPile;
+        discardPile.push_back(deck.deal_card());
         
         print_delayed("\nStarting discard: ", false);
-        cout << discardPile.top();
+        print_instant(card_name(discardPile.back()), false);
         
         bool knocked = false;
         bool p1Knocked = false;
+        HandMask p1Taken = 0, p2Taken = 0;
+        LayoffResult layoff = {0, 0};
         int turn = 0;
         
         // play until someone knocks or deck runs out
         while (!knocked && !deck.isEmpty()) {
-            turn++;
-            
             // player 1's turn
-            take_turn(deck, p1Hand, p1Name, discardPile, p1Sets, p1Runs, knocked);
+            turn++;
+            take_turn(deck, p1Hand, p1Name, discardPile, p1Sets, p1Runs, knocked, p1Taken, p2Taken,
+                      p1Player);
             if (knocked) {
                 p1Knocked = true;
                 
                 // Update opponent's melds for scoring
-                p2Sets = find_sets(p2Hand);
-                p2Runs = find_runs(p2Hand);
+                p2Hand.best_melds(p2Sets, p2Runs);
                 
-                score_round(p1Name, p1Hand, p1Sets, p1Runs, p1Score,
-                           p2Name, p2Hand, p2Sets, p2Runs, p2Score);
+                layoff = score_round(p1Name, p1Hand.cards(), p1Sets, p1Runs, p1Score,
+                                     p2Name, p2Hand.cards(), p2Sets, p2Runs, p2Score);
                 break;
             }
             
             // player 2's turn
-            take_turn(deck, p2Hand, p2Name, discardPile, p2Sets, p2Runs, knocked);
+            turn++;
+            take_turn(deck, p2Hand, p2Name, discardPile, p2Sets, p2Runs, knocked, p2Taken, p1Taken,
+                      p2Player);
             if (knocked) {
                 p1Knocked = false;
                 
                 // update opponent's melds for scoring
-                p1Sets = find_sets(p1Hand);
-                p1Runs = find_runs(p1Hand);
+                p1Hand.best_melds(p1Sets, p1Runs);
                 
-                score_round(p2Name, p2Hand, p2Sets, p2Runs, p2Score,
-                           p1Name, p1Hand, p1Sets, p1Runs, p1Score);
+                layoff = score_round(p2Name, p2Hand.cards(), p2Sets, p2Runs, p2Score,
+                                     p1Name, p1Hand.cards(), p1Sets, p1Runs, p1Score);
                 break;
             }
             
@@ -468,40 +535,68 @@ int main(int argc, const char * argv[]) {
             print_delayed("\n========== ROUND ENDS ==========");
             print_delayed("Deck is empty! Round ends in a draw (no points awarded).");
         }
+
+        RoundResult outcome;
+        if (knocked) {
+            int knocker = p1Knocked ? 0 : 1;
+            IncrementalHand& knockerHand = p1Knocked ? p1Hand : p2Hand;
+            outcome = knock_result(knocker, knockerHand.deadwood(), layoff.deadwood, turn);
+            outcome.laidOff = layoff.laidOff;
+        } else {
+            outcome.type = RoundEnd::StockOut;
+            outcome.turns = turn;
+        }
+        roundLog.end(outcome);
+        count_round(outcome);
+
+        // how the deal looked beforehand, for a table that has it
+        const string* names[2] = {&p1Name, &p2Name};
+        for (int seat = 0; seat < 2; ++seat) {
+            if (const HandValue* value = handValues.find(openingHands[seat])) {
+                char line[128];
+                snprintf(line, sizeof(line), "%s's opening hand: %+.1f points a round, won %.0f%%",
+                         names[seat]->c_str(), value->points, 100 * value->win_rate());
+                print_delayed(line);
+            }
+        }
         
         // Check if someone won the game (with 100 points)
-        if (p1Score >= 100) {
-            print_delayed("\n\n🏆🏆🏆 " + p1Name + " WINS THE GAME! 🏆🏆🏆");
-            print_delayed("Final Score: " + p1Name + " " + to_string(p1Score) + 
+        if (p1Score >= game_target) {
+            print_result("\n\n🏆🏆🏆 " + p1Name + " WINS THE GAME! 🏆🏆🏆");
+            print_result("Final Score: " + p1Name + " " + to_string(p1Score) + 
                          " - " + p2Name + " " + to_string(p2Score));
             break;
-        } else if (p2Score >= 100) {
-            print_delayed("\n\n🏆🏆🏆 " + p2Name + " WINS THE GAME! 🏆🏆🏆");
-            print_delayed("Final Score: " + p1Name + " " + to_string(p1Score) + 
+        } else if (p2Score >= game_target) {
+            print_result("\n\n🏆🏆🏆 " + p2Name + " WINS THE GAME! 🏆🏆🏆");
+            print_result("Final Score: " + p1Name + " " + to_string(p1Score) + 
                          " - " + p2Name + " " + to_string(p2Score));
             break;
         }
         
-        // ask if players want to play another round
-        int continueChoice = get_valid_input("\nPlay another round? (1=Yes, 2=No): ", 1, 2);
+        // ask if players want to play another round (two computers just play on)
+        int continueChoice = 1;
+        if (!p1Player || !p2Player) {
+            continueChoice = get_valid_input("\nPlay another round? (1=Yes, 2=No): ", 1, 2);
+        }
         
         if (continueChoice != 1) {
             playAgain = false;
-            print_delayed("\n=== FINAL SCORES ===");
-            print_delayed(p1Name + ": " + to_string(p1Score));
-            print_delayed(p2Name + ": " + to_string(p2Score));
+            print_result("\n=== FINAL SCORES ===");
+            print_result(p1Name + ": " + to_string(p1Score));
+            print_result(p2Name + ": " + to_string(p2Score));
             
             if (p1Score > p2Score) {
-                print_delayed("\n🏆 " + p1Name + " wins overall!");
+                print_result("\n🏆 " + p1Name + " wins overall!");
             } else if (p2Score > p1Score) {
-                print_delayed("\n🏆 " + p2Name + " wins overall!");
+                print_result("\n🏆 " + p2Name + " wins overall!");
             } else {
-                print_delayed("\n🤝 It's a tie!");
+                print_result("\n🤝 It's a tie!");
             }
         }
     }
     
     print_delayed("\nThanks for playing!");
+    screen.drain();
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,431 @@
+#ifndef metrics_h
+#define metrics_h
+
+#include "deck.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+/*
+    Counters and latency histograms for the hot paths, built in only when compiled
+    with -DGIN_METRICS. Without it every PhaseTimer and count() is an empty inline
+    function and the program is exactly what it was.
+
+    Each thread writes to a slot of its own, so recording is a plain load and store
+    on memory no other thread writes, with no lock and no shared cache line. The
+    slots are only added up when someone asks for a snapshot. Times are taken with
+    the CPU's time-stamp counter where there is one and turned into seconds at
+    snapshot time; each phase keeps a histogram of power-of-two buckets of ticks.
+
+    Reading the clock twice costs more than find_sets itself, so the meld kernels
+    and the deadwood solves (min_deadwood and solve_melds, which is what play runs)
+    count every call but only time one in 64; their sums and buckets are scaled up
+    by calls / timed when exported. Everything else is timed every call.
+
+    write_metrics() puts a snapshot in a file as Prometheus text, or as JSON when the
+    name ends in .json, writing a temporary file and renaming it over the old one so
+    a scraper never reads half a file. MetricsExporter does that every few seconds
+    from a thread of its own.
+*/
+
+namespace metrics {
+
+// the timed phases
+enum class Phase : uint8 {
+    Deal,
+    FindSets,
+    FindRuns,
+    CalculateDeadwood,
+    MinDeadwood,
+    SolveMelds,
+    EvaluateDiscards,
+    DrawDecision,
+    DiscardDecision,
+    ScoreRound
+};
+constexpr int phase_count = 10;
+
+// what happened to rounds; a gin or an undercut is also a knock
+enum class Counter : uint8 {
+    Rounds,
+    Knocks,
+    Gins,
+    Undercuts,
+    StockOuts
+};
+constexpr int counter_count = 5;
+
+constexpr const char* phase_names[phase_count] = {
+    "deal", "find_sets", "find_runs", "calculate_deadwood", "min_deadwood", "solve_melds",
+    "evaluate_discards", "draw_decision", "discard_decision", "score_round"
+};
+constexpr const char* counter_names[counter_count] = {
+    "rounds", "knocks", "gins", "undercuts", "stock_outs"
+};
+
+// 1 in (mask + 1) calls of each phase is timed
+constexpr uint64 phase_sample_mask[phase_count] = {0, 63, 63, 63, 63, 63, 0, 0, 0, 0};
+
+// bucket b counts the calls that took fewer than 2^b ticks (and at least 2^(b-1))
+constexpr int histogram_buckets = 40;
+
+struct PhaseStats {
+    uint64 calls = 0;
+    uint64 timed = 0;           // the calls that ticks and buckets are made of
+    uint64 ticks = 0;
+    uint64 buckets[histogram_buckets] = {};
+};
+
+struct MetricsSnapshot {
+    uint64 counters[counter_count] = {};
+    PhaseStats phases[phase_count];
+    double secondsPerTick = 0;
+    int threads = 0;
+};
+
+#ifdef GIN_METRICS
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+}
+
+#ifdef GIN_METRICS
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace metrics {
+
+inline uint64 ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return uint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+/*
+    One thread's numbers. Only its own thread writes them, so an update is a relaxed
+    load and store rather than a locked add; the atomics are there so a snapshot
+    taken from another thread is a clean read.
+*/
+struct alignas(64) ThreadSlot {
+    std::atomic<uint64> counters[counter_count] = {};
+    std::atomic<uint64> calls[phase_count] = {};
+    std::atomic<uint64> timed[phase_count] = {};
+    std::atomic<uint64> phaseTicks[phase_count] = {};
+    std::atomic<uint64> buckets[phase_count][histogram_buckets] = {};
+};
+
+inline void bump(std::atomic<uint64>& value, uint64 n) {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/*
+    Every thread's slot, kept for the life of the program so what a finished thread
+    counted still adds up. Also remembers when it was made in both clocks, which is
+    what converts ticks to seconds.
+*/
+class Registry
+{
+private:
+    std::mutex lock;
+    std::vector<std::unique_ptr<ThreadSlot>> slots;
+    uint64 startTicks;
+    std::chrono::steady_clock::time_point startTime;
+
+public:
+    Registry() : startTicks(ticks()), startTime(std::chrono::steady_clock::now()) {}
+
+    ThreadSlot* add() {
+        std::lock_guard<std::mutex> hold(lock);
+        slots.emplace_back(new ThreadSlot);
+        return slots.back().get();
+    }
+
+    MetricsSnapshot snapshot() {
+        // the tick rate needs a few ms between the two readings to be any good
+        while (std::chrono::steady_clock::now() - startTime < std::chrono::milliseconds(10)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        MetricsSnapshot s;
+        uint64 elapsedTicks = ticks() - startTicks;
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                       startTime).count();
+        s.secondsPerTick = elapsedTicks ? elapsed / double(elapsedTicks) : 0;
+
+        std::lock_guard<std::mutex> hold(lock);
+        s.threads = int(slots.size());
+        for (const auto& slot : slots) {
+            for (int c = 0; c < counter_count; ++c) {
+                s.counters[c] += slot->counters[c].load(std::memory_order_relaxed);
+            }
+            for (int p = 0; p < phase_count; ++p) {
+                PhaseStats& phase = s.phases[p];
+                phase.calls += slot->calls[p].load(std::memory_order_relaxed);
+                phase.timed += slot->timed[p].load(std::memory_order_relaxed);
+                phase.ticks += slot->phaseTicks[p].load(std::memory_order_relaxed);
+                for (int b = 0; b < histogram_buckets; ++b) {
+                    phase.buckets[b] += slot->buckets[p][b].load(std::memory_order_relaxed);
+                }
+            }
+        }
+        return s;
+    }
+};
+
+inline Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+inline ThreadSlot& thread_slot() {
+    thread_local ThreadSlot* slot = registry().add();
+    return *slot;
+}
+
+// gives the calling thread its slot now, so the first thing it times doesn't allocate
+inline void attach_thread() {
+    thread_slot();
+}
+
+inline void count(Counter c, uint64 n = 1) {
+    bump(thread_slot().counters[int(c)], n);
+}
+
+inline void record(ThreadSlot& slot, int p, uint64 elapsed) {
+    int bucket = elapsed ? 64 - __builtin_clzll(elapsed) : 0;
+    bump(slot.timed[p], 1);
+    bump(slot.phaseTicks[p], elapsed);
+    bump(slot.buckets[p][bucket < histogram_buckets ? bucket : histogram_buckets - 1], 1);
+}
+
+// counts the scope it lives in as one call of phase, and times it if it is sampled
+class PhaseTimer
+{
+private:
+    ThreadSlot& slot;
+    int phase;
+    bool timing;
+    uint64 start;
+
+public:
+    explicit PhaseTimer(Phase p) : slot(thread_slot()), phase(int(p)) {
+        uint64 n = slot.calls[phase].load(std::memory_order_relaxed);
+        slot.calls[phase].store(n + 1, std::memory_order_relaxed);
+        timing = (n & phase_sample_mask[phase]) == 0;
+        start = timing ? ticks() : 0;
+    }
+    ~PhaseTimer() {
+        if (timing) {
+            record(slot, phase, ticks() - start);
+        }
+    }
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+};
+
+inline MetricsSnapshot snapshot() {
+    return registry().snapshot();
+}
+
+}
+
+#else
+
+namespace metrics {
+
+inline void attach_thread() {}
+inline void count(Counter, uint64 = 1) {}
+
+class PhaseTimer
+{
+public:
+    explicit PhaseTimer(Phase) {}
+};
+
+inline MetricsSnapshot snapshot() {
+    return MetricsSnapshot();
+}
+
+}
+
+#endif
+
+namespace metrics {
+
+// the highest bucket with any calls in it, +1 (0 if the phase never ran)
+inline int used_buckets(const PhaseStats& phase) {
+    int used = histogram_buckets;
+    while (used > 0 && phase.buckets[used - 1] == 0) {
+        --used;
+    }
+    return used;
+}
+
+// calls per timed call, what a sampled phase's ticks and buckets are scaled up by
+inline double sample_scale(const PhaseStats& phase) {
+    return phase.timed ? double(phase.calls) / double(phase.timed) : 0;
+}
+
+// every call's time, estimated from the timed ones
+inline double phase_seconds(const PhaseStats& phase, double secondsPerTick) {
+    return double(phase.ticks) * sample_scale(phase) * secondsPerTick;
+}
+
+inline std::string number_text(double v) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.9g", v);
+    return text;
+}
+
+/*
+    Prometheus text format: a counter per round outcome and a histogram per phase,
+    labelled by phase, with cumulative buckets in seconds. Sampled phases have their
+    buckets scaled to the number of calls.
+*/
+inline std::string prometheus_text(const MetricsSnapshot& s) {
+    std::string out;
+    for (int c = 0; c < counter_count; ++c) {
+        std::string name = std::string("gin_") + counter_names[c] + "_total";
+        out += "# TYPE " + name + " counter\n";
+        out += name + " " + std::to_string(s.counters[c]) + "\n";
+    }
+    out += "# HELP gin_phase_seconds Time taken by each call of a phase.\n";
+    out += "# TYPE gin_phase_seconds histogram\n";
+    for (int p = 0; p < phase_count; ++p) {
+        const PhaseStats& phase = s.phases[p];
+        std::string label = std::string("phase=\"") + phase_names[p] + "\"";
+        uint64 below = 0;
+        for (int b = 0; b < used_buckets(phase); ++b) {
+            below += phase.buckets[b];
+            double le = double(uint64(1) << b) * s.secondsPerTick;
+            uint64 calls = std::min(uint64(double(below) * sample_scale(phase) + 0.5), phase.calls);
+            out += "gin_phase_seconds_bucket{" + label + ",le=\"" + number_text(le) + "\"} " +
+                   std::to_string(calls) + "\n";
+        }
+        out += "gin_phase_seconds_bucket{" + label + ",le=\"+Inf\"} " +
+               std::to_string(phase.calls) + "\n";
+        out += "gin_phase_seconds_sum{" + label + "} " +
+               number_text(phase_seconds(phase, s.secondsPerTick)) + "\n";
+        out += "gin_phase_seconds_count{" + label + "} " + std::to_string(phase.calls) + "\n";
+    }
+    return out;
+}
+
+/*
+    The same numbers as JSON. seconds is the estimate for every call, buckets are
+    [upper bound in seconds, timed calls in that bucket] as counted.
+*/
+inline std::string json_text(const MetricsSnapshot& s) {
+    std::string out = "{\n  \"counters\": {";
+    for (int c = 0; c < counter_count; ++c) {
+        out += std::string(c ? ", " : "") + "\"" + counter_names[c] + "\": " +
+               std::to_string(s.counters[c]);
+    }
+    out += "},\n  \"phases\": {\n";
+    for (int p = 0; p < phase_count; ++p) {
+        const PhaseStats& phase = s.phases[p];
+        out += std::string("    \"") + phase_names[p] + "\": {\"calls\": " +
+               std::to_string(phase.calls) + ", \"timed\": " + std::to_string(phase.timed) +
+               ", \"seconds\": " + number_text(phase_seconds(phase, s.secondsPerTick)) +
+               ", \"buckets\": [";
+        for (int b = 0; b < used_buckets(phase); ++b) {
+            out += std::string(b ? ", " : "") + "[" +
+                   number_text(double(uint64(1) << b) * s.secondsPerTick) + ", " +
+                   std::to_string(phase.buckets[b]) + "]";
+        }
+        out += std::string("]}") + (p + 1 < phase_count ? "," : "") + "\n";
+    }
+    return out + "  }\n}\n";
+}
+
+}
+
+#ifdef GIN_METRICS
+
+namespace metrics {
+
+// a snapshot into path (JSON if it ends in .json), replacing the file whole
+inline bool write_metrics(const std::string& path) {
+    MetricsSnapshot s = snapshot();
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    std::string text = json ? json_text(s) : prometheus_text(s);
+    std::string temp = path + ".tmp";
+    FILE* f = fopen(temp.c_str(), "w");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+    ok = fclose(f) == 0 && ok;
+    return ok && rename(temp.c_str(), path.c_str()) == 0;
+}
+
+/*
+    Writes the metrics to path every intervalMs from a thread of its own, and once
+    more when it is destroyed, so the file ends up with the final numbers.
+*/
+class MetricsExporter
+{
+private:
+    std::string path;
+    std::chrono::milliseconds interval;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread worker;
+
+    void run() {
+        std::unique_lock<std::mutex> hold(lock);
+        while (!wake.wait_for(hold, interval, [this] { return stopping; })) {
+            write_metrics(path);
+        }
+    }
+
+public:
+    MetricsExporter(const std::string& file, int intervalMs)
+        : path(file), interval(intervalMs), worker([this] { run(); }) {}
+
+    ~MetricsExporter() {
+        {
+            std::lock_guard<std::mutex> hold(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+        write_metrics(path);
+    }
+};
+
+}
+
+#else
+
+namespace metrics {
+
+inline bool write_metrics(const std::string&) {
+    return false;
+}
+
+class MetricsExporter
+{
+public:
+    MetricsExporter(const std::string&, int) {}
+};
+
+}
+
+#endif
+
+#endif /* metrics_h */
@@ -0,0 +1,147 @@
+#include <iostream>
+#include "deck.h"
+#include "card_utils.h"
+#include "gin_rummy.h"
+#include "game_io.h"
+#include "game_log.h"
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+using namespace std;
+
+/*
+    Replays a binary game log (written by gin_rummy --log or tournament --log).
+    Usage:
+        ./replay games.log              replay every round, check each one still adds up
+        ./replay games.log --show 12    print round 12 move by move
+*/
+
+const char* END_NAMES[] = {"none", "knock", "gin", "undercut", "stock-out"};
+
+// repeated cards (from a shoe of several packs) are listed once per copy
+string hand_text(const CardCounts& hand) {
+    string text = "[";
+    for (HandMask rest = hand.held(); rest; rest &= rest - 1) {
+        for (int copy = hand.count(rest & -rest); copy > 0; --copy) {
+            text += " " + card_name(bit_card(__builtin_ctzll(rest)));
+        }
+    }
+    return text + " ]";
+}
+
+void show_round(const LoggedRound& round, uint64 number) {
+    const LogRound& h = round.header;
+    uint8 decks = h.decks ? h.decks : 1;
+    Deck deck{Rng(h.seed), decks};
+    CardCounts hands[2];
+    hands[0] = deck.deal_counts(h.handSize);
+    hands[1] = deck.deal_counts(h.handSize);
+    Card upcard = deck.deal_card();
+
+    cout << "round " << number << ": seed " << h.seed << ", " << unsigned(h.handSize)
+         << " cards each, seat " << unsigned(h.firstSeat) << " first";
+    if (decks > 1) {
+        cout << ", " << unsigned(decks) << "-pack shoe";
+    }
+    cout << '\n';
+    cout << "  seat 0 dealt " << hand_text(hands[0]) << '\n';
+    cout << "  seat 1 dealt " << hand_text(hands[1]) << '\n';
+    cout << "  upcard " << card_name(upcard) << '\n';
+
+    int seat = h.firstSeat;
+    int draws = 0;
+    for (int i = 0; i < h.eventCount; ++i) {
+        uint8 e = round.events[i];
+        switch (event_type(e)) {
+            case LogEvent::DrawStock:
+            case LogEvent::DrawDiscard:
+                if (draws++ > 0) {
+                    seat = 1 - seat;
+                }
+                cout << "  seat " << seat << (event_type(e) == LogEvent::DrawStock ?
+                        " draws " : " takes the discard ") << card_name(event_card(e));
+                break;
+            case LogEvent::Discard:
+                cout << ", throws " << card_name(event_card(e));
+                break;
+            case LogEvent::Knock:
+                cout << (event_payload(e) ? ", knocks" : ", plays on");
+                break;
+        }
+        if (i + 1 == h.eventCount || event_type(round.events[i + 1]) == LogEvent::DrawStock ||
+            event_type(round.events[i + 1]) == LogEvent::DrawDiscard) {
+            cout << '\n';
+        }
+    }
+
+    cout << "  " << (h.end < 5 ? END_NAMES[h.end] : "?") << " after " << h.turns << " turns";
+    if (h.knocker >= 0) {
+        cout << ": seat " << int(h.knocker) << " knocked on " << unsigned(h.knockerDeadwood)
+             << ", opponent had " << unsigned(h.opponentDeadwood)
+             << (h.rules & log_rule_layoffs ? " after layoffs" : "") << ", seat " << int(h.winner)
+             << " scores " << h.points;
+    }
+    cout << '\n';
+}
+
+int main(int argc, const char * argv[]) {
+    if (argc < 2) {
+        cout << "usage: replay games.log [--show N]\n";
+        return 1;
+    }
+    string path = argv[1];
+    bool show = false;
+    uint64 wanted = 0;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--show" && i + 1 < argc) {
+            show = true;
+            wanted = strtoull(argv[++i], nullptr, 10);
+        } else {
+            cout << "usage: replay games.log [--show N]\n";
+            return 1;
+        }
+    }
+
+    GameLogReader log;
+    if (!log.open(path)) {
+        cout << "Can't read a game log from " << path << '\n';
+        return 1;
+    }
+
+    LoggedRound round;
+    uint64 number = 0;
+    if (show) {
+        while (log.next(round)) {
+            if (number++ == wanted) {
+                show_round(round, wanted);
+                return 0;
+            }
+        }
+        cout << "The log only has " << number << " rounds\n";
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    uint64 bad = 0;
+    uint64 events = 0;
+    RoundResult result;
+    HandMask hands[2];
+    while (log.next(round)) {
+        events += round.header.eventCount;
+        if (!replay_round(round, result, hands)) {
+            if (bad++ < 10) {
+                cout << "round " << number << " doesn't replay\n";
+            }
+        }
+        ++number;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << number << " rounds, " << events << " moves, " << log.size() << " bytes ("
+         << (number ? double(log.size()) / number : 0) << " per round)\n";
+    cout << "replayed in " << seconds << " s (" << (seconds > 0 ? number / seconds : 0)
+         << " rounds/s), " << bad << " didn't match\n";
+    return bad ? 1 : 0;
+}
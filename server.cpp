@@ -0,0 +1,915 @@
+#include <iostream>
+#include "deck.h"
+#include "card_utils.h"
+#include "gin_rummy.h"
+#include "game_io.h"
+#include "metrics.h"
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*
+    Hosts many games at once over local sockets (Linux, C++20). Usage:
+        ./server                                  serve on /tmp/gin_rummy.sock
+        ./server --port 7777 --threads 4          ...or on 127.0.0.1:7777 with 4 event loops
+        ./server --clients 2000 --games 20000     play test clients against a running server
+        ./server --metrics gin.prom               also write phase timings and round counts
+                                                  with the 5 s report (built with -DGIN_METRICS)
+
+    Every two connections that arrive are seated at a table. A table is a coroutine
+    (play_table) that plays a match with the headless Round rules and suspends in
+    co_await ReadLine whenever it needs a player's answer, so a waiting table is a
+    coroutine frame and two buffers, not a thread. Each event loop thread owns an
+    epoll and its tables outright; the main thread only accepts and hands out pairs.
+
+    Protocol, one line each way. The server asks:
+        draw? stock 31 top 9H hand 2C 3C ...    answer: stock | discard
+        discard? hand 2C 3C ...                 answer: a card (7H) or its place in the list (1-11)
+        knock? 8 hand 2C 3C ...                 answer: yes | no
+    and tells: welcome, round, you draw, opponent ..., result, scores, gameover.
+    A bad answer gets "error ..." and the question again, and a player who hangs up
+    forfeits. nc -U /tmp/gin_rummy.sock is enough to play by hand.
+*/
+
+const char* DEFAULT_SOCKET = "/tmp/gin_rummy.sock";
+const size_t MAX_LINE = 1024;   // a player sending more than this without a newline is dropped
+const int MAX_EVENTS = 256;
+
+atomic<bool> stopping{false};
+atomic<uint64> tablesOpened{0};
+atomic<uint64> tablesFinished{0};
+atomic<uint64> roundsPlayed{0};
+
+struct ServerAddress {
+    string socketPath = DEFAULT_SOCKET;
+    int port = 0;               // TCP on loopback instead of the Unix socket when set
+};
+
+void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+void set_nodelay(int fd, const ServerAddress& address) {
+    if (address.port) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+}
+
+int listen_on(const ServerAddress& address) {
+    int fd;
+    if (address.port) {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(uint16(address.port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || bind(fd, (sockaddr*) &addr, sizeof(addr)) != 0) {
+            return -1;
+        }
+    } else {
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, address.socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(address.socketPath.c_str());
+        if (fd < 0 || bind(fd, (sockaddr*) &addr, sizeof(addr)) != 0) {
+            return -1;
+        }
+    }
+    if (listen(fd, SOMAXCONN) != 0) {
+        return -1;
+    }
+    set_nonblocking(fd);
+    return fd;
+}
+
+int connect_to(const ServerAddress& address) {
+    int fd;
+    int result;
+    if (address.port) {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(uint16(address.port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        result = connect(fd, (sockaddr*) &addr, sizeof(addr));
+    } else {
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, address.socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        result = connect(fd, (sockaddr*) &addr, sizeof(addr));
+    }
+    if (result != 0) {
+        close(fd);
+        return -1;
+    }
+    set_nonblocking(fd);
+    set_nodelay(fd, address);
+    return fd;
+}
+
+// ---------------------------------------------------------------- server side
+
+struct Table;
+
+struct Connection {
+    int fd = -1;
+    string in;
+    string out;
+    bool closed = false;        // hung up, or sent garbage
+    bool writing = false;       // registered for EPOLLOUT
+    bool dirty = false;         // has output waiting for the end of the batch
+    coroutine_handle<> waiting; // the table, while it waits for a line from here
+    Table* table = nullptr;
+
+    bool has_line() const {
+        return in.find('\n') != string::npos;
+    }
+
+    bool take_line(string& line) {
+        size_t end = in.find('\n');
+        if (end == string::npos) {
+            return false;
+        }
+        line.assign(in, 0, end);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        in.erase(0, end + 1);
+        return true;
+    }
+};
+
+// the coroutine type of a table: starts straight away, stays around after it ends
+// so the loop can see it's done and free it
+struct TableTask {
+    struct promise_type {
+        TableTask get_return_object() {
+            return {coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        suspend_never initial_suspend() noexcept { return {}; }
+        suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+    };
+    coroutine_handle<promise_type> handle;
+};
+
+// co_await ReadLine{conn, opponent, line}: the next line from that player, false
+// if either player is gone (so a table doesn't wait on someone whose opponent left)
+struct ReadLine {
+    Connection& conn;
+    Connection& opponent;
+    string& line;
+    bool got = false;
+
+    bool await_ready() {
+        got = conn.take_line(line);
+        return got || conn.closed || opponent.closed;
+    }
+    void await_suspend(coroutine_handle<> table) {
+        conn.waiting = table;
+    }
+    bool await_resume() {
+        if (!got) {
+            got = conn.take_line(line);
+        }
+        return got;
+    }
+};
+
+struct Table {
+    uint64 id = 0;
+    unique_ptr<Connection> seats[2];
+    Deck deck;
+    Round round;
+    TableTask task;
+    bool over = false;
+};
+
+class EventLoop;
+TableTask play_table(EventLoop& loop, Table& t);
+
+class EventLoop
+{
+private:
+    int epoll = -1;
+    int wake = -1;              // eventfd, written when pairs are handed over
+
+    mutex lock;
+    deque<pair<int, int>> handedOver;   // fds of two players, from the accept thread
+
+    unordered_map<uint64, unique_ptr<Table>> tables;
+    vector<Table*> finished;
+    vector<Connection*> dirty;
+
+    void watch(Connection& c, uint32_t events) {
+        epoll_event e = {};
+        e.events = events;
+        e.data.ptr = &c;
+        epoll_ctl(epoll, EPOLL_CTL_MOD, c.fd, &e);
+    }
+
+    void open_table(int fd0, int fd1) {
+        static atomic<uint64> nextId{1};
+        auto table = make_unique<Table>();
+        Table* t = table.get();
+        t->id = nextId++;
+        int fds[2] = {fd0, fd1};
+        for (int s = 0; s < 2; ++s) {
+            t->seats[s] = make_unique<Connection>();
+            Connection& c = *t->seats[s];
+            c.fd = fds[s];
+            c.table = t;
+            epoll_event e = {};
+            e.events = EPOLLIN | EPOLLRDHUP;
+            e.data.ptr = &c;
+            epoll_ctl(epoll, EPOLL_CTL_ADD, c.fd, &e);
+        }
+        tables[t->id] = move(table);
+        tablesOpened++;
+
+        t->task = play_table(*this, *t);
+        if (t->task.handle.done()) {
+            finish(*t);
+        }
+    }
+
+    void finish(Table& t) {
+        if (!t.over) {
+            t.over = true;
+            finished.push_back(&t);
+        }
+    }
+
+    void flush(Connection& c) {
+        while (!c.out.empty() && !c.closed) {
+            ssize_t n = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+            if (n > 0) {
+                c.out.erase(0, size_t(n));
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!c.writing) {
+                    c.writing = true;
+                    watch(c, EPOLLIN | EPOLLRDHUP | EPOLLOUT);
+                }
+                return;
+            } else {
+                c.closed = true;
+                c.out.clear();
+            }
+        }
+        if (c.writing) {
+            c.writing = false;
+            watch(c, EPOLLIN | EPOLLRDHUP);
+        }
+    }
+
+    void on_readable(Connection& c) {
+        char buffer[4096];
+        while (!c.closed) {
+            ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                c.in.append(buffer, size_t(n));
+                if (c.in.size() > MAX_LINE && !c.has_line()) {
+                    c.closed = true;
+                }
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                c.closed = true;
+            }
+        }
+        if (c.closed) {
+            // level-triggered EOF would fire forever otherwise
+            epoll_ctl(epoll, EPOLL_CTL_DEL, c.fd, nullptr);
+        }
+
+        // wake the table if this is the line it waits for, or if a player left
+        Table& t = *c.table;
+        Connection* asked = t.seats[0]->waiting ? t.seats[0].get() :
+                            t.seats[1]->waiting ? t.seats[1].get() : nullptr;
+        if (asked && !t.over && (c.closed || (asked == &c && c.has_line()))) {
+            coroutine_handle<> table = asked->waiting;
+            asked->waiting = nullptr;
+            table.resume();
+            if (t.task.handle.done()) {
+                finish(t);
+            }
+        }
+    }
+
+    void take_handed_over() {
+        uint64 count;
+        ssize_t ignored = read(wake, &count, sizeof(count));
+        (void) ignored;
+        deque<pair<int, int>> pairs;
+        {
+            lock_guard<mutex> guard(lock);
+            pairs.swap(handedOver);
+        }
+        for (const auto& p : pairs) {
+            open_table(p.first, p.second);
+        }
+    }
+
+    // end of a batch: write what the tables said, close the tables that are done
+    void after_batch() {
+        for (Connection* c : dirty) {
+            c->dirty = false;
+            flush(*c);
+        }
+        dirty.clear();
+
+        size_t kept = 0;
+        for (Table* t : finished) {
+            bool draining = false;
+            for (auto& seat : t->seats) {
+                draining |= !seat->closed && !seat->out.empty();
+            }
+            if (draining) {
+                finished[kept++] = t;   // its last lines are still going out
+                continue;
+            }
+            for (auto& seat : t->seats) {
+                epoll_ctl(epoll, EPOLL_CTL_DEL, seat->fd, nullptr);
+                close(seat->fd);
+            }
+            t->task.handle.destroy();
+            tables.erase(t->id);
+            tablesFinished++;
+        }
+        finished.resize(kept);
+    }
+
+public:
+    EventLoop() {
+        epoll = epoll_create1(EPOLL_CLOEXEC);
+        wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event e = {};
+        e.events = EPOLLIN;
+        e.data.ptr = nullptr;   // nullptr marks the eventfd
+        epoll_ctl(epoll, EPOLL_CTL_ADD, wake, &e);
+    }
+
+    ~EventLoop() {
+        for (auto& entry : tables) {
+            if (entry.second->task.handle) {
+                entry.second->task.handle.destroy();
+            }
+            for (auto& seat : entry.second->seats) {
+                close(seat->fd);
+            }
+        }
+        close(wake);
+        close(epoll);
+    }
+
+    // called from the accept thread
+    void hand_over(int fd0, int fd1) {
+        {
+            lock_guard<mutex> guard(lock);
+            handedOver.emplace_back(fd0, fd1);
+        }
+        uint64 one = 1;
+        ssize_t ignored = write(wake, &one, sizeof(one));
+        (void) ignored;
+    }
+
+    void stop() {
+        uint64 one = 1;
+        ssize_t ignored = write(wake, &one, sizeof(one));
+        (void) ignored;
+    }
+
+    // queue a line; it is written once the current batch of events is handled
+    void send(Connection& c, const string& text) {
+        if (c.closed) {
+            return;
+        }
+        c.out += text;
+        c.out += '\n';
+        if (!c.dirty) {
+            c.dirty = true;
+            dirty.push_back(&c);
+        }
+    }
+
+    void run() {
+        epoll_event events[MAX_EVENTS];
+        while (!stopping) {
+            int n = epoll_wait(epoll, events, MAX_EVENTS, -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                Connection* c = static_cast<Connection*>(events[i].data.ptr);
+                if (!c) {
+                    take_handed_over();
+                    continue;
+                }
+                if (c->table->over) {
+                    // only its last lines are left to write, anything it sends is ignored
+                    if (events[i].events & EPOLLOUT) {
+                        flush(*c);
+                    } else {
+                        char buffer[512];
+                        if (recv(c->fd, buffer, sizeof(buffer), 0) <= 0) {
+                            c->closed = true;
+                            epoll_ctl(epoll, EPOLL_CTL_DEL, c->fd, nullptr);
+                        }
+                    }
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    flush(*c);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    on_readable(*c);
+                }
+            }
+            after_batch();
+        }
+    }
+};
+
+/*
+    One table: a whole match between the two seats, the same flow as take_turn and
+    the round loop in main(), but on the headless Round so the rules are the engine's.
+*/
+TableTask play_table(EventLoop& loop, Table& t) {
+    Connection* seats[2] = {t.seats[0].get(), t.seats[1].get()};
+    int scores[2] = {0, 0};
+    int forfeit = -1;           // seat that left
+    string line;
+
+    for (int s = 0; s < 2; ++s) {
+        loop.send(*seats[s], "welcome table " + to_string(t.id) + " seat " + to_string(s));
+    }
+
+    for (int number = 1; forfeit < 0 && scores[0] < game_target && scores[1] < game_target &&
+         number <= max_match_rounds; ++number) {
+        t.deck.new_deck();
+        t.round.deal(t.deck, standard_hand_size, (number - 1) % 2);
+        roundsPlayed++;
+        for (int s = 0; s < 2; ++s) {
+            loop.send(*seats[s], "round " + to_string(number) + " first " + to_string(t.round.to_move()));
+        }
+
+        while (t.round.phase() != Round::Over) {
+            int seat = t.round.to_move();
+            Connection& me = *seats[seat];
+            Connection& them = *seats[1 - seat];
+            HandMask hand = t.round.hand(seat);
+
+            if (t.round.phase() == Round::Draw) {
+                string question = "draw? stock " + to_string(t.round.stock_remaining()) + " top " +
+                                  (t.round.has_discard() ? card_name(t.round.top_discard()) : "--") +
+                                  " hand " + mask_text(hand);
+                while (true) {
+                    loop.send(me, question);
+                    if (!co_await ReadLine{me, them, line}) {
+                        forfeit = me.closed ? seat : 1 - seat;
+                        break;
+                    }
+                    if (line == "stock" || line == "discard") {
+                        break;
+                    }
+                    loop.send(me, "error answer stock or discard");
+                }
+                if (forfeit >= 0) {
+                    break;
+                }
+                uint16 stockBefore = t.round.stock_remaining();
+                Card drawn;
+                t.round.draw(line == "discard", drawn);
+                loop.send(me, "you draw " + card_name(drawn));
+                loop.send(them, t.round.stock_remaining() == stockBefore ?
+                          "opponent takes " + card_name(drawn) : "opponent draws stock");
+            } else if (t.round.phase() == Round::Discard) {
+                string question = "discard? hand " + mask_text(hand);
+                Card pick;
+                while (true) {
+                    loop.send(me, question);
+                    if (!co_await ReadLine{me, them, line}) {
+                        forfeit = me.closed ? seat : 1 - seat;
+                        break;
+                    }
+                    bool isIndex = !line.empty() && line.find_first_not_of("0123456789") == string::npos;
+                    int place = isIndex ? atoi(line.c_str()) : 0;
+                    if (place >= 1 && place <= card_count(hand)) {
+                        HandMask rest = hand;
+                        for (int i = 1; i < place; ++i) {
+                            rest &= rest - 1;
+                        }
+                        pick = bit_card(__builtin_ctzll(rest));
+                    } else if (!parse_card(line, pick)) {
+                        loop.send(me, "error answer a card from your hand, eg. 7H");
+                        continue;
+                    }
+                    if (t.round.discard(pick)) {
+                        break;
+                    }
+                    loop.send(me, "error " + card_name(pick) + " isn't in your hand");
+                }
+                if (forfeit >= 0) {
+                    break;
+                }
+                loop.send(them, "opponent discards " + card_name(pick));
+            } else {
+                string question = "knock? " + to_string(t.round.deadwood()) + " hand " + mask_text(hand);
+                while (true) {
+                    loop.send(me, question);
+                    if (!co_await ReadLine{me, them, line}) {
+                        forfeit = me.closed ? seat : 1 - seat;
+                        break;
+                    }
+                    if (line == "yes" || line == "no") {
+                        break;
+                    }
+                    loop.send(me, "error answer yes or no");
+                }
+                if (forfeit >= 0) {
+                    break;
+                }
+                t.round.knock(line == "yes");
+                if (line == "yes") {
+                    loop.send(them, "opponent knocks");
+                }
+            }
+        }
+        if (forfeit >= 0) {
+            break;
+        }
+
+        const RoundResult& r = t.round.result();
+        count_round(r);
+        if (r.winner >= 0) {
+            scores[r.winner] += r.points;
+        }
+        string result = "result " + string(round_end_words[uint8(r.type)]) + " knocker " +
+                        to_string(r.knocker) + " winner " + to_string(r.winner) + " points " +
+                        to_string(r.points) + " deadwood " + to_string(r.knockerDeadwood) + " " +
+                        to_string(r.opponentDeadwood);
+        string hands = "hands " + mask_text(t.round.hand(0)) + " / " + mask_text(t.round.hand(1));
+        string score = "scores " + to_string(scores[0]) + " " + to_string(scores[1]);
+        for (int s = 0; s < 2; ++s) {
+            loop.send(*seats[s], result);
+            loop.send(*seats[s], hands);
+            loop.send(*seats[s], score);
+        }
+    }
+
+    if (forfeit >= 0) {
+        loop.send(*seats[1 - forfeit], "gameover " + to_string(1 - forfeit) + " forfeit");
+    } else {
+        int winner = scores[0] == scores[1] ? -1 : scores[0] > scores[1] ? 0 : 1;
+        for (int s = 0; s < 2; ++s) {
+            loop.send(*seats[s], "gameover " + to_string(winner));
+        }
+    }
+}
+
+void on_signal(int) {
+    stopping = true;
+}
+
+int serve(const ServerAddress& address, unsigned threads, const string& metricsPath) {
+    int listener = listen_on(address);
+    if (listener < 0) {
+        cout << "Can't listen on " << (address.port ? "port " + to_string(address.port) : address.socketPath)
+             << ": " << strerror(errno) << '\n';
+        return 1;
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = on_signal;     // no SA_RESTART, so poll() wakes up
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    vector<unique_ptr<EventLoop>> loops;
+    vector<thread> pool;
+    for (unsigned i = 0; i < threads; ++i) {
+        loops.push_back(make_unique<EventLoop>());
+    }
+    for (auto& loop : loops) {
+        pool.emplace_back(&EventLoop::run, loop.get());
+    }
+
+    cout << "serving on " << (address.port ? "127.0.0.1:" + to_string(address.port) : address.socketPath)
+         << " with " << threads << " event loops, Ctrl-C to stop\n";
+
+    // accept here and pair in arrival order; the pair goes to the next loop
+    int waiting = -1;
+    size_t next = 0;
+    auto lastReport = chrono::steady_clock::now();
+    uint64 reportedRounds = 0;
+    while (!stopping) {
+        pollfd p = {listener, POLLIN, 0};
+        poll(&p, 1, 1000);
+        int fd;
+        while ((fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            set_nodelay(fd, address);
+            if (waiting < 0) {
+                waiting = fd;
+            } else {
+                loops[next]->hand_over(waiting, fd);
+                next = (next + 1) % loops.size();
+                waiting = -1;
+            }
+        }
+
+        auto now = chrono::steady_clock::now();
+        double seconds = chrono::duration<double>(now - lastReport).count();
+        if (seconds >= 5) {
+            uint64 rounds = roundsPlayed;
+            if (rounds != reportedRounds) {
+                cout << "tables open " << tablesOpened - tablesFinished << ", finished "
+                     << tablesFinished << ", " << uint64((rounds - reportedRounds) / seconds)
+                     << " rounds/s\n";
+            }
+            reportedRounds = rounds;
+            lastReport = now;
+            if (!metricsPath.empty()) {
+                metrics::write_metrics(metricsPath);
+            }
+        }
+    }
+
+    for (auto& loop : loops) {
+        loop->stop();
+    }
+    for (thread& t : pool) {
+        t.join();
+    }
+    if (waiting >= 0) {
+        close(waiting);
+    }
+    close(listener);
+    if (!address.port) {
+        unlink(address.socketPath.c_str());
+    }
+    if (!metricsPath.empty()) {
+        metrics::write_metrics(metricsPath);
+    }
+    cout << "\nserved " << tablesOpened << " tables, " << roundsPlayed << " rounds\n";
+    return 0;
+}
+
+// ---------------------------------------------------------------- test clients
+
+struct TestClient {
+    int fd = -1;
+    string in;
+    string out;
+    bool writing = false;
+    BotPolicy bot;
+};
+
+struct ClientStats {
+    uint64 games = 0;           // gameover lines, one per seat
+    uint64 rounds = 0;          // round lines, one per seat
+    uint64 answers = 0;
+    uint64 errors = 0;
+    uint64 forfeits = 0;
+    uint64 dropped = 0;         // connections the server closed mid-game
+};
+
+HandMask read_hand(istringstream& words) {
+    HandMask hand = 0;
+    string word;
+    Card c;
+    while (words >> word) {
+        if (parse_card(word, c)) {
+            hand |= card_bit(c);
+        }
+    }
+    return hand;
+}
+
+// the bot's answer to one line from the server, empty when none is wanted
+string answer(TestClient& client, const string& line, ClientStats& stats) {
+    istringstream words(line);
+    string kind, word;
+    words >> kind;
+    TurnView view = {};
+    if (kind == "draw?") {
+        // draw? stock 31 top 9H hand ...
+        string top;
+        words >> word >> view.stockRemaining >> word >> top >> word;
+        view.hasDiscard = parse_card(top, view.topDiscard);
+        view.hand = read_hand(words);
+        return client.bot.draw_from_discard(view) ? "discard" : "stock";
+    }
+    if (kind == "discard?") {
+        words >> word;
+        view.hand = read_hand(words);
+        return card_name(client.bot.choose_discard(view));
+    }
+    if (kind == "knock?") {
+        int deadwood;
+        words >> deadwood >> word;
+        view.hand = read_hand(words);
+        return client.bot.knock(view, deadwood) ? "yes" : "no";
+    }
+    if (kind == "round") {
+        stats.rounds++;
+    } else if (kind == "gameover") {
+        stats.games++;
+        stats.forfeits += line.find("forfeit") != string::npos;
+    } else if (kind == "error") {
+        stats.errors++;
+    }
+    return string();
+}
+
+int run_clients(const ServerAddress& address, unsigned concurrency, uint64 games) {
+    uint64 toOpen = 2 * games;
+    concurrency += concurrency % 2;
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    ClientStats stats;
+    uint64 opened = 0;
+    uint64 open = 0;
+
+    auto connect_one = [&]() {
+        auto client = new TestClient();
+        client->fd = connect_to(address);
+        if (client->fd < 0) {
+            cout << "Can't connect: " << strerror(errno) << '\n';
+            delete client;
+            return false;
+        }
+        epoll_event e = {};
+        e.events = EPOLLIN | EPOLLRDHUP;
+        e.data.ptr = client;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, client->fd, &e);
+        opened++;
+        open++;
+        return true;
+    };
+    auto disconnect = [&](TestClient* client) {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, client->fd, nullptr);
+        close(client->fd);
+        delete client;
+        open--;
+    };
+    auto flush = [&](TestClient* client) {
+        while (!client->out.empty()) {
+            ssize_t n = ::send(client->fd, client->out.data(), client->out.size(), MSG_NOSIGNAL);
+            if (n > 0) {
+                client->out.erase(0, size_t(n));
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                break;
+            }
+        }
+        bool want = !client->out.empty();
+        if (want != client->writing) {
+            client->writing = want;
+            epoll_event e = {};
+            e.events = EPOLLIN | EPOLLRDHUP | (want ? uint32_t(EPOLLOUT) : 0u);
+            e.data.ptr = client;
+            epoll_ctl(epoll, EPOLL_CTL_MOD, client->fd, &e);
+        }
+    };
+
+    auto start = chrono::steady_clock::now();
+    while (opened < toOpen && open < concurrency) {
+        if (!connect_one()) {
+            return 1;
+        }
+    }
+
+    epoll_event events[MAX_EVENTS];
+    char buffer[4096];
+    while (open > 0) {
+        int n = epoll_wait(epoll, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            TestClient* client = static_cast<TestClient*>(events[i].data.ptr);
+            if (events[i].events & EPOLLOUT) {
+                flush(client);
+            }
+            bool gone = false;
+            bool done = false;
+            while (true) {
+                ssize_t got = recv(client->fd, buffer, sizeof(buffer), 0);
+                if (got > 0) {
+                    client->in.append(buffer, size_t(got));
+                } else if (got < 0 && errno == EINTR) {
+                    continue;
+                } else {
+                    gone = got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+                    break;
+                }
+            }
+            size_t begin = 0, end;
+            while ((end = client->in.find('\n', begin)) != string::npos) {
+                string line = client->in.substr(begin, end - begin);
+                begin = end + 1;
+                string reply = answer(*client, line, stats);
+                if (!reply.empty()) {
+                    client->out += reply + '\n';
+                    stats.answers++;
+                }
+                done |= line.compare(0, 8, "gameover") == 0;
+            }
+            client->in.erase(0, begin);
+            flush(client);
+
+            if (done || gone) {
+                stats.dropped += gone && !done;
+                disconnect(client);
+                while (opened < toOpen && open < concurrency) {
+                    if (!connect_one()) {
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    close(epoll);
+
+    cout << "\n========== TEST CLIENTS ==========\n";
+    cout << stats.games / 2 << " games, " << stats.rounds / 2 << " rounds with " << concurrency
+         << " connections in " << seconds << " s\n";
+    cout << (seconds > 0 ? stats.games / 2 / seconds : 0) << " games/s, "
+         << (seconds > 0 ? stats.rounds / 2 / seconds : 0) << " rounds/s, "
+         << (seconds > 0 ? stats.answers / seconds : 0) << " moves/s\n";
+    cout << "errors " << stats.errors << ", forfeits " << stats.forfeits << ", dropped "
+         << stats.dropped << '\n';
+    return stats.errors || stats.dropped ? 1 : 0;
+}
+
+int main(int argc, const char * argv[]) {
+    ServerAddress address;
+    unsigned threads = thread::hardware_concurrency();
+    unsigned clients = 0;
+    uint64 games = 1000;
+    string metricsPath;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--socket" && hasValue) {
+            address.socketPath = argv[++i];
+        } else if (arg == "--port" && hasValue) {
+            address.port = atoi(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            threads = unsigned(atoi(argv[++i]));
+        } else if (arg == "--clients" && hasValue) {
+            clients = unsigned(atoi(argv[++i]));
+        } else if (arg == "--games" && hasValue) {
+            games = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--metrics" && hasValue && metrics::enabled) {
+            metricsPath = argv[++i];
+        } else {
+            cout << "usage: server [--socket path | --port N] [--threads T]"
+                 << (metrics::enabled ? " [--metrics file]" : "") << "\n"
+                    "       server --clients C [--games G] [--socket path | --port N]\n";
+            return 1;
+        }
+    }
+    if (threads == 0) threads = 1;
+
+    if (clients > 0) {
+        return run_clients(address, clients, games);
+    }
+    return serve(address, threads, metricsPath);
+}
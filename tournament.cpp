@@ -0,0 +1,433 @@
+#include <iostream>
+#include "deck.h"
+#include "gin_rummy.h"
+#include "game_log.h"
+#include "ismcts.h"
+#include "alloc_count.h"
+#include "deadwood_cache.h"
+#include "metrics.h"
+#include "outs.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+    Runs N automated matches between two policies on every core and reports how
+    they did. Usage:
+        ./tournament --matches 100000 --p1 greedy --p2 random --seed 42 --threads 8
+        ./tournament --matches 1000 --log games.log     also append every round to a game log
+        ./tournament --decks 2                          deal from a 2-pack shoe
+        ./tournament --p1 ismcts --iterations 2000      tree search, 2000 playouts per decision
+        ./tournament --cache                            share one cache of solved hands between threads
+        ./tournament --rules oklahoma                   play a rule variant: standard, straight,
+                                                        oklahoma or acehigh (see gin_rummy.h)
+        ./tournament --metrics gin.prom                 write phase timings and round counts
+                                                        every few seconds (built with -DGIN_METRICS)
+
+    Match i is always played with seed mix_seed(seed + i), whichever thread ends up
+    running it, and the stats are integer sums, so the same seed gives the same report.
+    (Rounds go into the log in whatever order the threads finish them.)
+*/
+
+const int DEFAULT_BATCH = 64;   // matches a worker takes from its own range at a time
+const uint64 DEFAULT_ITERATIONS = 1000;  // per ismcts decision
+const int CACHE_LOG2_ENTRIES = 20;      // --cache table: 2^20 entries, 16 MB
+const int METRICS_INTERVAL_MS = 5000;   // how often --metrics rewrites its file
+
+// a contiguous range of match numbers packed into one word, so it can be CASed
+// [begin, end) -> begin in the high 32 bits, end in the low 32
+uint64 pack_range(uint32 begin, uint32 end) {
+    return (uint64(begin) << 32) | end;
+}
+uint32 range_begin(uint64 r) { return uint32(r >> 32); }
+uint32 range_end(uint64 r) { return uint32(r); }
+
+// everything one worker learns, summed only after the threads are joined
+// alignas keeps each worker on its own cache line
+struct alignas(64) WorkerStats {
+    uint64 matches = 0;
+    uint64 wins[2] = {0, 0};            // indexed by policy (0 = p1, 1 = p2), not seat
+    int64_t pointDiff = 0;              // p1's match points minus p2's
+    uint64 pointDiffSquared = 0;
+    uint64 points[2] = {0, 0};
+    uint64 rounds = 0;
+    uint64 knocks[2] = {0, 0};
+    uint64 gins[2] = {0, 0};
+    uint64 undercuts[2] = {0, 0};       // times this policy undercut the other's knock
+    uint64 stockOuts = 0;
+    uint64 allocations = 0;             // heap allocations made while playing, should stay 0
+
+    void merge(const WorkerStats& o) {
+        matches += o.matches;
+        pointDiff += o.pointDiff;
+        pointDiffSquared += o.pointDiffSquared;
+        rounds += o.rounds;
+        stockOuts += o.stockOuts;
+        allocations += o.allocations;
+        for (int p = 0; p < 2; ++p) {
+            wins[p] += o.wins[p];
+            points[p] += o.points[p];
+            knocks[p] += o.knocks[p];
+            gins[p] += o.gins[p];
+            undercuts[p] += o.undercuts[p];
+        }
+    }
+};
+
+struct alignas(64) WorkerQueue {
+    atomic<uint64> range{0};
+};
+
+// ismcts runs a fixed number of iterations on one thread instead of a time budget,
+// so its games still only depend on the seed and the workers already fill the cores
+unique_ptr<PlayerPolicy> make_policy(const string& name, uint64 iterations = DEFAULT_ITERATIONS,
+                                     DeadwoodCache* cache = nullptr) {
+    if (name == "greedy") {
+        return unique_ptr<PlayerPolicy>(new GreedyPolicy(cache));
+    }
+    if (name == "bot") {
+        return unique_ptr<PlayerPolicy>(new BotPolicy(cache));
+    }
+    if (name == "outs") {
+        return unique_ptr<PlayerPolicy>(new OutsPolicy(cache));
+    }
+    if (name == "random") {
+        return unique_ptr<PlayerPolicy>(new RandomPolicy());
+    }
+    if (name == "ismcts") {
+        return unique_ptr<PlayerPolicy>(new SearchPolicy(0, 1, iterations));
+    }
+    return nullptr;
+}
+
+bool valid_policy(const string& name) {
+    return make_policy(name) != nullptr;
+}
+
+/*
+    Take the next batch from our own range. Returns false once it is empty.
+*/
+bool take_batch(WorkerQueue& own, uint32 batch, uint32& begin, uint32& end) {
+    uint64 current = own.range.load(memory_order_acquire);
+    while (true) {
+        uint32 b = range_begin(current);
+        uint32 e = range_end(current);
+        if (b >= e) {
+            return false;
+        }
+        uint32 next = e - b > batch ? b + batch : e;
+        if (own.range.compare_exchange_weak(current, pack_range(next, e), memory_order_acq_rel)) {
+            begin = b;
+            end = next;
+            return true;
+        }
+    }
+}
+
+/*
+    Our range is empty: take the back half of the fullest other range and make it ours.
+    Returns false when there is nothing left anywhere.
+*/
+bool steal(vector<WorkerQueue>& queues, size_t self) {
+    while (true) {
+        size_t victim = self;
+        uint32 most = 0;
+        uint64 seen = 0;
+        for (size_t i = 0; i < queues.size(); ++i) {
+            uint64 r = queues[i].range.load(memory_order_acquire);
+            uint32 left = range_end(r) > range_begin(r) ? range_end(r) - range_begin(r) : 0;
+            if (i != self && left > most) {
+                most = left;
+                victim = i;
+                seen = r;
+            }
+        }
+        if (victim == self) {
+            return false;
+        }
+
+        uint32 b = range_begin(seen);
+        uint32 e = range_end(seen);
+        uint32 mid = b + (e - b) / 2;
+        // leave the owner its front half; a single match left goes to the thief whole
+        if (queues[victim].range.compare_exchange_strong(seen, pack_range(b, mid),
+                                                          memory_order_acq_rel)) {
+            queues[self].range.store(pack_range(mid, e), memory_order_release);
+            return true;
+        }
+        // lost a race with the owner or another thief, look again
+    }
+}
+
+template <class Engine>
+void play_matches(uint32 begin, uint32 end, uint64 seed, Engine& engine,
+                  PlayerPolicy& p1, PlayerPolicy& p2, WorkerStats& stats) {
+    for (uint32 i = begin; i < end; ++i) {
+        uint64 matchSeed = mix_seed(seed + i);
+        engine.reseed(matchSeed);
+        p1.reseed(mix_seed(matchSeed + 1));
+        p2.reseed(mix_seed(matchSeed + 2));
+
+        // swap seats every match so neither policy always has seat 0
+        int p1Seat = i % 2;
+        MatchResult match = p1Seat == 0 ? engine.play_match(p1, p2) : engine.play_match(p2, p1);
+
+        stats.matches++;
+        stats.rounds += match.rounds;
+        stats.stockOuts += match.stockOuts;
+        for (int p = 0; p < 2; ++p) {
+            int seat = p == 0 ? p1Seat : 1 - p1Seat;
+            if (match.winner == seat) {
+                stats.wins[p]++;
+            }
+            stats.points[p] += match.scores[seat];
+            stats.knocks[p] += match.knocks[seat];
+            stats.gins[p] += match.gins[seat];
+            stats.undercuts[p] += match.undercuts[seat];
+        }
+
+        int64_t diff = match.scores[p1Seat] - match.scores[1 - p1Seat];
+        stats.pointDiff += diff;
+        stats.pointDiffSquared += uint64(diff * diff);
+    }
+}
+
+template <class Rules>
+void worker(size_t self, vector<WorkerQueue>& queues, uint32 batch, uint64 seed, uint8 decks,
+            uint64 iterations, const string& p1Name, const string& p2Name, GameLogWriter& log,
+            DeadwoodCache* cache, WorkerStats& stats) {
+    BasicGameEngine<Rules> engine(Rules::handSize, decks);
+    engine.use_cache(cache);
+    unique_ptr<PlayerPolicy> p1 = make_policy(p1Name, iterations, cache);
+    unique_ptr<PlayerPolicy> p2 = make_policy(p2Name, iterations, cache);
+    RoundLog roundLog(log);
+    if (log.is_open()) {
+        engine.watch(&roundLog);
+    }
+
+    // everything a match needs is set up by now, playing should never allocate
+    metrics::attach_thread();
+    uint64 allocationsBefore = heap_allocations();
+    uint32 begin, end;
+    while (true) {
+        while (take_batch(queues[self], batch, begin, end)) {
+            play_matches(begin, end, seed, engine, *p1, *p2, stats);
+        }
+        if (!steal(queues, self)) {
+            break;
+        }
+    }
+    stats.allocations = heap_allocations() - allocationsBefore;
+}
+
+typedef void (*WorkerFn)(size_t, vector<WorkerQueue>&, uint32, uint64, uint8, uint64,
+                         const string&, const string&, GameLogWriter&, DeadwoodCache*,
+                         WorkerStats&);
+
+// the worker compiled for the named rule variant, nullptr if there is none
+WorkerFn rules_worker(const string& rules) {
+    if (rules == StandardGin::name) return worker<StandardGin>;
+    if (rules == StraightGin::name) return worker<StraightGin>;
+    if (rules == OklahomaGin::name) return worker<OklahomaGin>;
+    if (rules == AceHighGin::name) return worker<AceHighGin>;
+    return nullptr;
+}
+
+// 95% Wilson score interval for a proportion
+void wilson(uint64 hits, uint64 n, double& low, double& high) {
+    if (n == 0) {
+        low = high = 0;
+        return;
+    }
+    const double z = 1.96;
+    double p = double(hits) / n;
+    double denom = 1 + z * z / n;
+    double centre = (p + z * z / (2 * n)) / denom;
+    double spread = z * sqrt(p * (1 - p) / n + z * z / (4.0 * n * n)) / denom;
+    low = centre - spread;
+    high = centre + spread;
+}
+
+string rate_line(uint64 hits, uint64 n) {
+    double low, high;
+    wilson(hits, n, low, high);
+    char buffer[96];
+    snprintf(buffer, sizeof(buffer), "%6.2f%%  [%6.2f%%, %6.2f%%]",
+             n ? 100.0 * hits / n : 0.0, 100 * low, 100 * high);
+    return buffer;
+}
+
+void print_report(const WorkerStats& s, const string names[2], const string& rules,
+                  double seconds) {
+    uint64 n = s.matches;
+    double meanDiff = n ? double(s.pointDiff) / n : 0;
+    double variance = n > 1 ? (double(s.pointDiffSquared) - n * meanDiff * meanDiff) / (n - 1) : 0;
+    double diffSpread = n ? 1.96 * sqrt(variance > 0 ? variance : 0) / sqrt(double(n)) : 0;
+
+    cout << "\n========== TOURNAMENT ==========\n";
+    cout << names[0] << " vs " << names[1] << ", " << rules << " rules: " << n << " matches, "
+         << s.rounds
+         << " rounds in " << seconds << " s (" << (seconds > 0 ? s.rounds / seconds : 0)
+         << " rounds/s)\n";
+    cout << "95% confidence intervals in brackets\n\n";
+
+    for (int p = 0; p < 2; ++p) {
+        cout << names[p] << (p == 0 ? " (p1)" : " (p2)") << '\n';
+        cout << "  win rate:       " << rate_line(s.wins[p], n) << '\n';
+        cout << "  avg points:     " << (n ? double(s.points[p]) / n : 0) << " per match\n";
+        cout << "  gin rate:       " << rate_line(s.gins[p], s.rounds) << " of rounds\n";
+        cout << "  undercut rate:  " << rate_line(s.undercuts[1 - p], s.knocks[p])
+             << " of its knocks\n";
+    }
+
+    cout << "\np1 margin:        " << meanDiff << " +/- " << diffSpread << " points per match\n";
+    cout << "stock-out rounds: " << rate_line(s.stockOuts, s.rounds) << '\n';
+    cout << "heap allocations: " << s.allocations << " while playing ("
+         << (s.rounds ? double(s.allocations) / s.rounds : 0) << " per round)\n";
+}
+
+int main(int argc, const char * argv[]) {
+    uint64 matches = 10000;
+    uint64 seed = 1;
+    uint32 batch = DEFAULT_BATCH;
+    unsigned threads = thread::hardware_concurrency();
+    unsigned decks = 1;
+    uint64 iterations = DEFAULT_ITERATIONS;
+    string names[2] = {"greedy", "random"};
+    string logPath, metricsPath;
+    string rules = StandardGin::name;
+    bool useCache = false;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--matches" && hasValue) {
+            matches = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && hasValue) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--threads" && hasValue) {
+            threads = unsigned(atoi(argv[++i]));
+        } else if (arg == "--batch" && hasValue) {
+            batch = uint32(atoi(argv[++i]));
+        } else if (arg == "--p1" && hasValue) {
+            names[0] = argv[++i];
+        } else if (arg == "--p2" && hasValue) {
+            names[1] = argv[++i];
+        } else if (arg == "--decks" && hasValue) {
+            decks = unsigned(atoi(argv[++i]));
+        } else if (arg == "--iterations" && hasValue) {
+            iterations = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--log" && hasValue) {
+            logPath = argv[++i];
+        } else if (arg == "--cache") {
+            useCache = true;
+        } else if (arg == "--metrics" && hasValue) {
+            metricsPath = argv[++i];
+        } else if (arg == "--rules" && hasValue) {
+            rules = argv[++i];
+        } else {
+            cout << "usage: tournament [--matches N] [--seed S] [--threads T] [--batch B]"
+                    " [--p1 POLICY] [--p2 POLICY] [--decks N] [--iterations N] [--log games.log]"
+                    " [--cache] [--metrics file] [--rules RULES]\n"
+                    "policies: greedy, bot, outs, random, ismcts\n"
+                    "rules: standard, straight, oklahoma, acehigh\n";
+            return 1;
+        }
+    }
+
+    if (!valid_policy(names[0]) || !valid_policy(names[1])) {
+        cout << "Unknown policy! Choose greedy, bot, outs, random or ismcts.\n";
+        return 1;
+    }
+    if (matches > 0xFFFFFFFFULL) {
+        cout << "Too many matches (max " << 0xFFFFFFFFULL << ")\n";
+        return 1;
+    }
+    if (iterations == 0) {
+        cout << "Iterations must be at least 1\n";
+        return 1;
+    }
+    if (decks == 0 || decks > max_decks) {
+        cout << "Decks must be 1 to " << unsigned(max_decks) << "\n";
+        return 1;
+    }
+    WorkerFn run = rules_worker(rules);
+    if (!run) {
+        cout << "Unknown rules! Choose standard, straight, oklahoma or acehigh.\n";
+        return 1;
+    }
+    if (rules == AceHighGin::name && decks > 1) {
+        cout << "Ace-high rules are one pack only\n";
+        return 1;
+    }
+    // a log is replayed with the standard rules, so it would score a variant wrongly
+    if (!logPath.empty() && rules != StandardGin::name) {
+        cout << "Only standard rules can be logged\n";
+        return 1;
+    }
+    if (!metricsPath.empty() && !metrics::enabled) {
+        cout << "This tournament was built without metrics, rebuild with -DGIN_METRICS\n";
+        return 1;
+    }
+    if (threads == 0) threads = 1;
+    if (batch == 0) batch = 1;
+
+    GameLogWriter log;
+    if (!logPath.empty() && !log.open(logPath)) {
+        cout << "Can't write a game log to " << logPath << '\n';
+        return 1;
+    }
+
+    unique_ptr<DeadwoodCache> cache;
+    if (useCache) {
+        cache.reset(new DeadwoodCache(CACHE_LOG2_ENTRIES));
+    }
+
+    // split the matches evenly to start with, stealing evens it out later
+    vector<WorkerQueue> queues(threads);
+    vector<WorkerStats> stats(threads);
+    for (unsigned t = 0; t < threads; ++t) {
+        uint32 begin = uint32(matches * t / threads);
+        uint32 end = uint32(matches * (t + 1) / threads);
+        queues[t].range.store(pack_range(begin, end));
+    }
+
+    unique_ptr<metrics::MetricsExporter> exporter;
+    if (!metricsPath.empty()) {
+        exporter.reset(new metrics::MetricsExporter(metricsPath, METRICS_INTERVAL_MS));
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    vector<thread> pool;
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back(run, size_t(t), ref(queues), batch, seed, uint8(decks), iterations,
+                          cref(names[0]), cref(names[1]), ref(log), cache.get(), ref(stats[t]));
+    }
+    for (thread& t : pool) {
+        t.join();
+    }
+    exporter.reset();   // writes the final numbers
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    WorkerStats total;
+    for (const WorkerStats& s : stats) {
+        total.merge(s);
+    }
+    print_report(total, names, rules, seconds);
+    if (cache) {
+        DeadwoodCacheStats c = cache->stats();
+        cout << "deadwood cache:   " << 100 * c.hit_rate() << "% hits of " << c.hits + c.misses
+             << " lookups (hands with overlapping melds)\n";
+    }
+
+    return 0;
+}